@@ -6,13 +6,45 @@
 #include <algorithm>
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
 #include <utility>
-#include <windows.h>
 #include <string>
 #include <random>
 #include <iterator> 
 #include <cstdlib> 
 #include <ctime>   
+#include <chrono>
+#include <memory>
+#include <cctype>
+#include <sstream>
+#include <tuple>
+#include <numeric>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <charconv>
+#include <string_view>
+#include <iomanip>
+#include <array>
+#include <limits>
+#include <cstdint>
+#include <functional>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 
 using json = nlohmann::json;
@@ -95,6 +127,7 @@ struct MachineBatch
     double TotalWeightedDelay;
     std::vector<Batch> Batches;
     std::vector<DelayedBatchInfo> delayedBatchInfo;
+    std::uint64_t Hash = 0; // 本機台排程的 Zobrist 雜湊，與 TotalWeightedDelay 在同樣的地方更新
 };
 
 struct DelayedBatch {
@@ -104,6 +137,159 @@ struct DelayedBatch {
     int MachineId;
 };
 
+// SplitMix64 的終結函數，用於亂數產生器與排程雜湊
+inline std::uint64_t mix64(std::uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// 計數器式亂數產生器：第 n 個輸出為 mix(key + n × 黃金比例常數)，狀態只有 key 與計數器。
+// split 由 key 與串流編號導出互不相關的子串流，因此每次求解、每個執行緒都能從同一個種子重現
+class CounterRng
+{
+public:
+    using result_type = std::uint64_t;
+
+    explicit CounterRng(std::uint64_t seed = 0) : key(mix64(seed ^ StreamSalt)) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()()
+    {
+        return mix64(key + Golden * ++counter);
+    }
+
+    // 0 到 count - 1 的均勻整數，count 必須大於 0
+    size_t index(size_t count)
+    {
+        return std::uniform_int_distribution<size_t>(0, count - 1)(*this);
+    }
+
+    CounterRng split(std::uint64_t stream) const
+    {
+        CounterRng child;
+        child.key = mix64(key ^ mix64(stream + Golden));
+        return child;
+    }
+
+    std::uint64_t streamKey() const { return key; }
+
+    // 以 FNV-1a 把名稱轉成串流編號，讓同一實例不論由哪個執行緒求解都拿到相同的串流
+    static std::uint64_t streamId(std::string_view name)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+        for (unsigned char c : name) {
+            hash = (hash ^ c) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+private:
+    static constexpr std::uint64_t Golden = 0x9e3779b97f4a7c15ULL;
+    static constexpr std::uint64_t StreamSalt = 0x632be59bd9b4e019ULL;
+
+    std::uint64_t key = 0;
+    std::uint64_t counter = 0;
+};
+
+// Zobrist 式排程雜湊：每個「零件 → (機台, 批次位置)」指派以帶金鑰的 mix64 產生 64 位元鍵，排程雜湊是所有鍵的和。
+// 用加法而不是 XOR，同一批次內的相同零件才不會互相抵銷；零件以 (零件類型, 訂單) 識別，
+// 同訂單的相同零件可以互換，交換後仍是同一個排程。批次內的零件順序不影響目標值，因此不列入
+const std::uint64_t zobristKey = 0x2545f4914f6cdd1dULL;
+
+inline std::uint64_t batchSlot(int machineId, size_t batchIndex)
+{
+    return mix64(zobristKey ^ (static_cast<std::uint64_t>(static_cast<std::uint32_t>(machineId)) << 32 | batchIndex));
+}
+
+// 一個零件放在某個 (機台, 批次位置) 的雜湊項；批次雜湊是各零件項的和，搬動單一零件時可以只加減這一項
+inline std::uint64_t partHash(std::uint64_t slot, const PartTypeOrderInfo& part)
+{
+    std::uint64_t partKey = static_cast<std::uint64_t>(static_cast<std::uint32_t>(part.partType->PartTypeId)) << 32
+        | static_cast<std::uint32_t>(part.orderInfo.OrderId);
+    return mix64(slot ^ mix64(partKey + zobristKey));
+}
+
+inline std::uint64_t batchHash(int machineId, size_t batchIndex, const Batch& batch)
+{
+    std::uint64_t slot = batchSlot(machineId, batchIndex);
+    std::uint64_t hash = 0;
+    for (const auto& part : batch.parts) {
+        hash += partHash(slot, part);
+    }
+    return hash;
+}
+
+std::uint64_t scheduleHash(const std::vector<MachineBatch>& machineBatches)
+{
+    std::uint64_t hash = 0;
+    for (const auto& machineBatch : machineBatches) {
+        hash += machineBatch.Hash;
+    }
+    return hash;
+}
+
+// 置換表：直接映射、容量固定為 2 的冪次的 雜湊 → 目標值 表，槽位衝突時直接覆蓋。容量 0 表示停用。
+// 禁忌鄰域先以增量方式算出移動後的雜湊再查表，命中時直接沿用目標值、不重算延遲；
+// 模擬退火的各步驟在產生候選解的同時就算出了目標值，命中只用來判斷重複訪問
+class TranspositionTable
+{
+public:
+    explicit TranspositionTable(size_t capacity)
+    {
+        if (capacity > 0) {
+            size_t size = 1;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            entries.resize(size);
+            mask = size - 1;
+        }
+    }
+
+    // 命中時把保存的目標值寫入 objective
+    bool lookup(std::uint64_t hash, double& objective)
+    {
+        if (entries.empty()) {
+            return false;
+        }
+        Lookups++;
+        const Entry& entry = entries[hash & mask];
+        if (!entry.Used || entry.Hash != hash) {
+            return false;
+        }
+        Hits++;
+        objective = entry.Objective;
+        return true;
+    }
+
+    void store(std::uint64_t hash, double objective)
+    {
+        if (!entries.empty()) {
+            entries[hash & mask] = { hash, objective, true };
+        }
+    }
+
+    size_t capacity() const { return entries.size(); }
+
+    long long Lookups = 0;
+    long long Hits = 0;
+
+private:
+    struct Entry
+    {
+        std::uint64_t Hash = 0;
+        double Objective = 0.0;
+        bool Used = false;
+    };
+
+    std::vector<Entry> entries;
+    size_t mask = 0;
+};
+
 const Machine& findMachineById(const std::vector<std::pair<int, Machine>>& sortedMachines, int machineId) {
     auto it = std::find_if(sortedMachines.begin(), sortedMachines.end(),
         [machineId](const std::pair<int, Machine>& machinePair) {
@@ -293,6 +479,19 @@ double calculateFinishTime(const Batch& batch, const int& machineId, const Machi
 
     return volumeTime + heightTime;
 }
+// 換料設定時間，與 createMachineBatches/insertBatch 相同：第一批用 StartSetup，換材料時加總新材料那一列 MaterialSetup，同材料為 0。
+// previousMaterial < 0 表示這是機台上的第一批
+double setupTime(const Machine& machine, int previousMaterial, int material)
+{
+    if (previousMaterial < 0) {
+        return machine.StartSetup[material];
+    }
+    if (previousMaterial == material) {
+        return 0.0;
+    }
+    return std::accumulate(machine.MaterialSetup[material].begin(), machine.MaterialSetup[material].end(), 0.0);
+}
+
 bool canAddPartToMachineBatch(const PartTypeOrderInfo& partInfo, const Machine& machine, double currentBatchArea) {
     double volumeTime = partInfo.partType->Volume * machine.ScanTime;
     double heightTime = partInfo.partType->Height * machine.RecoatTime;
@@ -303,7 +502,7 @@ struct AllocationResult { //
     std::map<int, std::vector<PartTypeOrderInfo>> updatedMaterials;
 };
 
-static int currentBatchId = 0;
+static thread_local int currentBatchId = 0;
 
 
 AllocationResult allocateMaterialToMachine(MachineBatch& selectedMachineBatch, int selectedMaterial,
@@ -533,6 +732,7 @@ std::vector<MachineBatch> createMachineBatches(
         machineBatchRef.RunningTime += finishTime;
 
         machineBatchRef.Batches.push_back(result.batch);
+        machineBatchRef.Hash += batchHash(machineBatchRef.MachineId, machineBatchRef.Batches.size() - 1, result.batch);
 
 
         DelayedBatchInfo delayedInfo{
@@ -583,6 +783,7 @@ void updateMachineBatches(MachineBatch& machineBatch, const std::vector<std::pai
 
     machineBatch.RunningTime = 0;
     machineBatch.TotalWeightedDelay = 0;
+    machineBatch.Hash = 0;
 
     const Machine* machine = nullptr;
     for (const auto& machinePair : sortedMachines)
@@ -596,7 +797,11 @@ void updateMachineBatches(MachineBatch& machineBatch, const std::vector<std::pai
 
     machineBatch.delayedBatchInfo.clear();
 
+    int lastMaterial = -1;
     for (auto& batch : machineBatch.Batches) {
+        // 與建構時相同計入換料設定時間，所有引擎共用同一個目標
+        machineBatch.RunningTime += setupTime(*machine, lastMaterial, batch.materialType);
+        lastMaterial = batch.materialType;
         double finishTime = calculateFinishTime(batch, machineBatch.MachineId, machine);
         machineBatch.RunningTime += finishTime;
         double batchDelay = calculateWeightedDelay(batch, machineBatch.RunningTime);
@@ -611,6 +816,7 @@ void updateMachineBatches(MachineBatch& machineBatch, const std::vector<std::pai
             }
         }
         batch.totalArea = totalArea;
+        machineBatch.Hash += batchHash(machineBatch.MachineId, &batch - &machineBatch.Batches[0], batch);
 
         if (batchDelay > 0) {
             DelayedBatchInfo dbInfo;
@@ -625,6 +831,150 @@ void updateMachineBatches(MachineBatch& machineBatch, const std::vector<std::pai
 }
 
 
+// 單機批次重排的位元遮罩 DP 上限；另以標籤總數限制記憶體 (2^21 個標籤約 64 MB)，超過時改用相鄰交換
+constexpr int MaxResequenceBatches = 20;
+constexpr size_t MaxResequenceLabels = size_t(1) << 21;
+
+// 重新排列一台機台的批次順序 (批次內容不變)，目標與 updateMachineBatches 相同，含換料設定時間。
+// 批次數不超過 threshold 時以位元遮罩 DP 求最佳順序。換料時間只取決於前一批的材料，但同一個子集合
+// 換料次數不同時完工時間也不同，所以狀態 (子集合 S, 最後一批的材料) 保存 (加權延遲, 完工時間) 的柏瑞圖前緣：
+// 延遲對完工時間單調，兩者都不差的標籤支配其他標籤。超過 threshold 時反覆交換相鄰批次直到沒有改進。
+// 只有在總加權延遲下降時才套用，回傳是否改變了順序
+bool resequenceMachineBatches(MachineBatch& machineBatch, const std::vector<std::pair<int, Machine>>& sortedMachines, int threshold)
+{
+    size_t count = machineBatch.Batches.size();
+    if (count < 2) {
+        return false;
+    }
+    const Machine* machine = nullptr;
+    for (const auto& machinePair : sortedMachines) {
+        if (machinePair.first == machineBatch.MachineId) {
+            machine = &machinePair.second;
+            break;
+        }
+    }
+    if (!machine) {
+        return false;
+    }
+    const auto& batches = machineBatch.Batches;
+    std::vector<double> times(count);
+    for (size_t i = 0; i < count; i++) {
+        times[i] = calculateFinishTime(batches[i], machineBatch.MachineId, machine);
+    }
+    // 依 order 排列時的總加權延遲 (含換料時間)，與 updateMachineBatches 相同
+    auto sequenceDelay = [&](const std::vector<size_t>& order) {
+        double completion = 0.0, delay = 0.0;
+        int lastMaterial = -1;
+        for (size_t index : order) {
+            completion += setupTime(*machine, lastMaterial, batches[index].materialType) + times[index];
+            lastMaterial = batches[index].materialType;
+            delay += calculateWeightedDelay(batches[index], completion);
+        }
+        return delay;
+    };
+
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    double before = sequenceDelay(order);
+    double after = before;
+    bool solved = false;
+    if (static_cast<int>(count) <= std::min(threshold, MaxResequenceBatches)) {
+        // 每個子集合的標籤連續存放在 labels[first[mask], first[mask + 1])，Parent 指向 mask 去掉 Batch 後的標籤
+        struct Label
+        {
+            double Delay;
+            double Time;
+            std::uint32_t Parent;
+            int Material;
+            int Batch;
+        };
+        size_t subsets = size_t(1) << count;
+        std::vector<Label> labels = { { 0.0, 0.0, 0, -1, -1 } };
+        std::vector<std::uint32_t> first(subsets + 1, 0);
+        first[1] = 1;
+        std::vector<Label> candidates;
+        bool overflow = false;
+        for (size_t mask = 1; mask < subsets && !overflow; mask++) {
+            candidates.clear();
+            for (size_t j = 0; j < count; j++) {
+                if (!(mask >> j & 1)) {
+                    continue;
+                }
+                size_t rest = mask ^ (size_t(1) << j);
+                int material = batches[j].materialType;
+                for (std::uint32_t k = first[rest]; k < first[rest + 1]; k++) {
+                    double time = labels[k].Time + setupTime(*machine, labels[k].Material, material) + times[j];
+                    candidates.push_back({ labels[k].Delay + calculateWeightedDelay(batches[j], time), time, k, material, static_cast<int>(j) });
+                }
+            }
+            // 同材料內依完工時間排序，只留延遲嚴格變小的標籤
+            std::sort(candidates.begin(), candidates.end(), [](const Label& x, const Label& y) {
+                return std::tie(x.Material, x.Time, x.Delay) < std::tie(y.Material, y.Time, y.Delay);
+                });
+            for (size_t c = 0; c < candidates.size(); c++) {
+                if (c > 0 && candidates[c].Material == candidates[c - 1].Material
+                    && candidates[c].Delay >= labels.back().Delay) {
+                    continue;
+                }
+                labels.push_back(candidates[c]);
+            }
+            first[mask + 1] = static_cast<std::uint32_t>(labels.size());
+            overflow = labels.size() > MaxResequenceLabels;
+        }
+        if (!overflow) {
+            std::uint32_t bestLabel = first[subsets - 1];
+            for (std::uint32_t k = first[subsets - 1]; k < first[subsets]; k++) {
+                bestLabel = labels[k].Delay < labels[bestLabel].Delay ? k : bestLabel;
+            }
+            after = labels[bestLabel].Delay;
+            for (std::uint32_t k = bestLabel, i = static_cast<std::uint32_t>(count); labels[k].Batch >= 0; k = labels[k].Parent) {
+                order[--i] = static_cast<size_t>(labels[k].Batch);
+            }
+            solved = true;
+        }
+    }
+    if (!solved) {
+        // 相鄰交換會改變後面所有批次的換料與完工時間，因此每次都重算整台機台
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            for (size_t i = 0; i + 1 < count; i++) {
+                std::swap(order[i], order[i + 1]);
+                double swapped = sequenceDelay(order);
+                if (swapped < after - 1e-9) {
+                    after = swapped;
+                    improved = true;
+                }
+                else {
+                    std::swap(order[i], order[i + 1]);
+                }
+            }
+        }
+    }
+    if (after >= before - 1e-9) {
+        return false;
+    }
+
+    std::vector<Batch> reordered;
+    reordered.reserve(count);
+    for (size_t index : order) {
+        reordered.push_back(std::move(machineBatch.Batches[index]));
+    }
+    machineBatch.Batches = std::move(reordered);
+    updateMachineBatches(machineBatch, sortedMachines);
+    return true;
+}
+
+// 對每台機台重排批次，回傳改變了順序的機台數
+int resequenceSchedule(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, int threshold)
+{
+    int changed = 0;
+    for (auto& machineBatch : machineBatches) {
+        changed += resequenceMachineBatches(machineBatch, sortedMachines, threshold) ? 1 : 0;
+    }
+    return changed;
+}
+
 bool compareDelayedBatches(const DelayedBatch& a, const DelayedBatch& b) {
     const auto& partA = a.batch.parts.front().orderInfo;
     const auto& partB = b.batch.parts.front().orderInfo;
@@ -701,6 +1051,7 @@ void insertBatch(MachineBatch* machineBatch, int position, DelayedBatch& delayed
 
     machineBatch->RunningTime = 0.0;
     machineBatch->TotalWeightedDelay = 0.0;
+    machineBatch->Hash = 0;
     machineBatch->delayedBatchInfo.clear();
 
     int lastMaterial = -1;
@@ -736,6 +1087,7 @@ void insertBatch(MachineBatch* machineBatch, int position, DelayedBatch& delayed
         machineBatch->RunningTime += finishTime;
         double batchDelay = calculateWeightedDelay(currentBatch, machineBatch->RunningTime);
         machineBatch->TotalWeightedDelay += batchDelay;
+        machineBatch->Hash += batchHash(machineBatch->MachineId, i, currentBatch);
 
         // 如果存在延迟，则记录在 DelayedBatchInfo 中
         if (batchDelay > 0) {
@@ -808,12 +1160,14 @@ void reintegrateDelayedBatches(std::vector<MachineBatch>& machineBatches, std::v
     }
 }
 
-std::vector<DelayedBatch> extractAndRandomSelectDelayedBatches(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
+std::vector<DelayedBatch> extractAndRandomSelectDelayedBatches(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, CounterRng& rng) {
     std::vector<DelayedBatch> allDelayedBatches;
-    DelayedBatch maxDelayBatch;
+    std::vector<std::pair<size_t, int>> locations; // 每個延遲批次的 (機台索引, 批次索引)；batchId 不保證唯一，移除時依位置
+    size_t maxDelayIndex = 0;
     double maxDelay = -1;
 
-    for (auto& machineBatch : machineBatches) {
+    for (size_t machineIndex = 0; machineIndex < machineBatches.size(); ++machineIndex) {
+        auto& machineBatch = machineBatches[machineIndex];
         for (auto& dbInfo : machineBatch.delayedBatchInfo) {
             if (dbInfo.WeightedDelay > 0) {
                 DelayedBatch delayedBatch;
@@ -822,52 +1176,59 @@ std::vector<DelayedBatch> extractAndRandomSelectDelayedBatches(std::vector<Machi
                 delayedBatch.time = dbInfo.thisBatchTime;
                 delayedBatch.MachineId = machineBatch.MachineId;
                 allDelayedBatches.push_back(delayedBatch);
+                locations.emplace_back(machineIndex, dbInfo.BatchIndex);
 
                 if (dbInfo.WeightedDelay > maxDelay) {
                     maxDelay = dbInfo.WeightedDelay;
-                    maxDelayBatch = delayedBatch;
+                    maxDelayIndex = allDelayedBatches.size() - 1;
                 }
             }
         }
     }
 
+    if (allDelayedBatches.empty()) {
+        return {};
+    }
+
     // 2. 除了加权延迟最大的批次外，从剩余的延迟批次中随机选择其他批次
-    std::vector<DelayedBatch> selectedBatches = { maxDelayBatch }; // 包括最大延迟批次
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(allDelayedBatches.begin(), allDelayedBatches.end(), g);
-
-    std::uniform_int_distribution<> dist(1, allDelayedBatches.size() - 1); // 随机数量，至少选择一个
-    size_t numBatchesToSelect = dist(g);
-    for (size_t i = 0; i < numBatchesToSelect && i < allDelayedBatches.size(); ++i) {
-        // 检查是否为最大延迟批次，通过比较某个唯一属性，如 MachineId 和 WeightedDelay
-        if (!(allDelayedBatches[i].MachineId == maxDelayBatch.MachineId &&
-            allDelayedBatches[i].WeightedDelay == maxDelayBatch.WeightedDelay &&
-            allDelayedBatches[i].time == maxDelayBatch.time)) {
-            selectedBatches.push_back(allDelayedBatches[i]);
-        }
-    }
-    // 3. 从 MachineBatch 中移除选中的延迟批次
-    for (auto& selectedBatch : selectedBatches) {
-        for (auto& machineBatch : machineBatches) {
-            if (machineBatch.MachineId == selectedBatch.MachineId) {
-                auto it = std::find_if(machineBatch.Batches.begin(), machineBatch.Batches.end(), [&](const Batch& b) {
-                    return b.batchId == selectedBatch.batch.batchId;
-                    });
-                if (it != machineBatch.Batches.end()) {
-                    machineBatch.Batches.erase(it);
-                }
-            }
+    std::vector<size_t> selectedIndices = { maxDelayIndex }; // 包括最大延迟批次
+    std::vector<size_t> candidates(allDelayedBatches.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+    std::shuffle(candidates.begin(), candidates.end(), rng);
+
+    size_t numBatchesToSelect = 0;
+    if (allDelayedBatches.size() > 1) {
+        std::uniform_int_distribution<> dist(1, allDelayedBatches.size() - 1); // 随机数量，至少选择一个
+        numBatchesToSelect = dist(rng);
+    }
+    for (size_t i = 0; i < numBatchesToSelect && i < candidates.size(); ++i) {
+        if (candidates[i] != maxDelayIndex) {
+            selectedIndices.push_back(candidates[i]);
         }
     }
 
+    std::vector<DelayedBatch> selectedBatches;
+    selectedBatches.reserve(selectedIndices.size());
+    for (size_t index : selectedIndices) {
+        selectedBatches.push_back(allDelayedBatches[index]);
+    }
+
+    // 3. 从 MachineBatch 中移除选中的延迟批次，同一機台由後往前刪除以免索引位移
+    std::sort(selectedIndices.begin(), selectedIndices.end(), [&](size_t a, size_t b) {
+        return locations[a] > locations[b];
+        });
+    for (size_t index : selectedIndices) {
+        auto& batches = machineBatches[locations[index].first].Batches;
+        batches.erase(batches.begin() + locations[index].second);
+    }
+
     for (auto& machineBatch : machineBatches) {
         updateMachineBatches(machineBatch, sortedMachines);
     }
     return selectedBatches;
 }
 
-std::vector<PartTypeOrderInfo> extractAndRandomSelectParts(std::vector<MachineBatch>& machineBatches) {
+std::vector<PartTypeOrderInfo> extractAndRandomSelectParts(std::vector<MachineBatch>& machineBatches, CounterRng& rng) {
     std::vector<PartTypeOrderInfo> allDelayedParts;
     DelayedBatch maxDelayBatch;
     double maxWeightedDelay = 0;
@@ -875,7 +1236,7 @@ std::vector<PartTypeOrderInfo> extractAndRandomSelectParts(std::vector<MachineBa
     for (auto& machineBatch : machineBatches) {
         for (auto& delayedInfo : machineBatch.delayedBatchInfo) {
             if (delayedInfo.WeightedDelay > 0) {
-                if (delayedInfo.BatchIndex <= 0 || delayedInfo.BatchIndex > machineBatch.Batches.size()) {
+                if (delayedInfo.BatchIndex <= 0 || delayedInfo.BatchIndex > static_cast<int>(machineBatch.Batches.size())) {
                     continue;
                 }
                 Batch& delayedBatch = machineBatch.Batches[delayedInfo.BatchIndex - 1];
@@ -897,11 +1258,9 @@ std::vector<PartTypeOrderInfo> extractAndRandomSelectParts(std::vector<MachineBa
         return {};
     }
 
-    std::random_device rd;
-    std::mt19937 g(rd());
     std::vector<PartTypeOrderInfo> maxDelayParts;
     if (maxDelayBatchIndex != -1) {
-        if (maxDelayBatchIndex < 0 || maxDelayBatchIndex >= allDelayedParts.size()) {
+        if (maxDelayBatchIndex < 0 || maxDelayBatchIndex >= static_cast<int>(allDelayedParts.size())) {
             // 最大延迟批次的起始索引超出范围，直接返回
             return {};
         }
@@ -914,11 +1273,14 @@ std::vector<PartTypeOrderInfo> extractAndRandomSelectParts(std::vector<MachineBa
         allDelayedParts.erase(maxDelayStart, maxDelayEnd);
     }
 
-    std::shuffle(allDelayedParts.begin(), allDelayedParts.end(), g);
-    std::uniform_int_distribution<int> dist(0, allDelayedParts.size() - 1);
-    int beta = dist(g) + maxDelayParts.size();
+    std::shuffle(allDelayedParts.begin(), allDelayedParts.end(), rng);
+    int beta = maxDelayParts.size();
+    if (!allDelayedParts.empty()) {
+        std::uniform_int_distribution<int> dist(0, allDelayedParts.size() - 1);
+        beta += dist(rng);
+    }
     std::vector<PartTypeOrderInfo> selectedParts = maxDelayParts;
-    for (int i = 0; i < beta - maxDelayParts.size() && i < allDelayedParts.size(); ++i) {
+    for (int i = 0; i < beta - static_cast<int>(maxDelayParts.size()) && i < static_cast<int>(allDelayedParts.size()); ++i) {
         selectedParts.push_back(allDelayedParts[i]);
     }
 
@@ -927,6 +1289,9 @@ std::vector<PartTypeOrderInfo> extractAndRandomSelectParts(std::vector<MachineBa
 
 
 void updateMachineBatchesAfterExtraction(std::vector<MachineBatch>& machineBatches, const std::vector<PartTypeOrderInfo>& extractedParts, const std::vector<std::pair<int, Machine>>& sortedMachines) {
+    // 每個抽取的零件只刪除一次，且只在它原本的機台上刪除；相同零件可能在同一批次出現多次
+    std::vector<char> removed(extractedParts.size(), 0);
+
     // 遍歷所有機器批次
     for (auto& machineBatch : machineBatches) {
         // 使用迭代器遍歷批次，以便可以在迭代過程中刪除元素
@@ -937,7 +1302,9 @@ void updateMachineBatchesAfterExtraction(std::vector<MachineBatch>& machineBatch
             for (auto partIt = batchIt->parts.begin(); partIt != batchIt->parts.end();) {
                 // 查找當前零件是否在抽取的零件列表中
                 auto foundIt = std::find_if(extractedParts.begin(), extractedParts.end(), [&](const PartTypeOrderInfo& extractedPart) {
-                    return extractedPart.batchId == batchIt->batchId &&
+                    return !removed[&extractedPart - extractedParts.data()] &&
+                        extractedPart.machineID == machineBatch.MachineId &&
+                        extractedPart.batchId == batchIt->batchId &&
                         extractedPart.Material == partIt->Material &&
                         extractedPart.orderInfo.OrderId == partIt->orderInfo.OrderId &&
                         extractedPart.partType->PartTypeId == partIt->partType->PartTypeId &&
@@ -946,6 +1313,7 @@ void updateMachineBatchesAfterExtraction(std::vector<MachineBatch>& machineBatch
 
                 if (foundIt != extractedParts.end()) {
                     // 如果找到，刪除零件並更新 batchIsEmpty 標記
+                    removed[foundIt - extractedParts.begin()] = 1;
                     partIt = batchIt->parts.erase(partIt);
                 }
                 else {
@@ -1006,11 +1374,11 @@ std::tuple<int, int> findOverallBestInsertionPosition(std::vector<MachineBatch>&
     int bestBatchIndex = -1;
     double bestAdditionalDelay = std::numeric_limits<double>::max();
 
-    for (int machineIndex = 0; machineIndex < machineBatches.size(); ++machineIndex) {
+    for (int machineIndex = 0; machineIndex < static_cast<int>(machineBatches.size()); ++machineIndex) {
         MachineBatch& machineBatch = machineBatches[machineIndex];
         const Machine& machine = findMachineById(sortedMachines, machineBatch.MachineId);
 
-        for (int batchIndex = 0; batchIndex < machineBatch.Batches.size(); ++batchIndex) {
+        for (int batchIndex = 0; batchIndex < static_cast<int>(machineBatch.Batches.size()); ++batchIndex) {
             Batch& batch = machineBatch.Batches[batchIndex];
 
             if (canInsertPartToBatch(partInfo, batch, machine)) {
@@ -1036,13 +1404,13 @@ std::tuple<int, int> findBestInsertionPosition(std::vector<MachineBatch>& machin
     double bestAdditionalDelay = std::numeric_limits<double>::max();
     double leastRunningTime = std::numeric_limits<double>::max();
 
-    for (int machineIndex = 0; machineIndex < machineBatches.size(); ++machineIndex) {
+    for (int machineIndex = 0; machineIndex < static_cast<int>(machineBatches.size()); ++machineIndex) {
         MachineBatch& machineBatch = machineBatches[machineIndex];
         const Machine& machine = findMachineById(sortedMachines, machineBatch.MachineId);
 
         double currentRunningTime = machineBatch.RunningTime;
 
-        for (int batchIndex = 0; batchIndex < machineBatch.Batches.size(); ++batchIndex) {
+        for (int batchIndex = 0; batchIndex < static_cast<int>(machineBatch.Batches.size()); ++batchIndex) {
 
             Batch& batch = machineBatch.Batches[batchIndex];
             double finishTime = calculateFinishTime(batch, machineBatch.MachineId, &machine);
@@ -1070,7 +1438,7 @@ std::tuple<int, int> findBestInsertionPosition(std::vector<MachineBatch>& machin
 
 void insertPartAtPosition(MachineBatch& machineBatch, int batchIndex, const PartTypeOrderInfo& partInfo, const std::vector<std::pair<int, Machine>>& sortedMachines) {
     // 如果是新批次，则初始化；否则，添加到现有批次
-    if (batchIndex >= machineBatch.Batches.size()) {
+    if (batchIndex >= static_cast<int>(machineBatch.Batches.size())) {
         Batch newBatch;
         newBatch.batchId = partInfo.batchId; // 使用新零件的 PartTypeID 作为新批次的 ID
         newBatch.materialType = partInfo.Material;
@@ -1099,7 +1467,7 @@ int findMachineBatchIndexByMachineId(const std::vector<MachineBatch>& machineBat
     }
     return -1; // 或者抛出异常
 }
-void printPartTypeOrderInfos(const std::vector<PartTypeOrderInfo>& partTypeOrderInfos, std::ofstream& outFile) {
+void printPartTypeOrderInfos(const std::vector<PartTypeOrderInfo>& partTypeOrderInfos, std::ostream& outFile) {
     for (const auto& partInfo : partTypeOrderInfos) {
         outFile << "----------------------------------" << "\n";
         outFile << "MachineID: " << partInfo.machineID << "\n";
@@ -1160,7 +1528,113 @@ void sortAndInsertParts(std::vector<MachineBatch>& machineBatches, const std::ve
 
 
 
-void printMachineBatch(const std::vector<MachineBatch> MachineBatchs, std::ofstream& outFile)
+// 報告輸出器：以 std::to_chars 將數字格式化到可重複使用的緩衝區，累積成大區塊後才寫入串流。
+// 浮點數採用與 iostream 預設相同的 %g 六位有效數字，輸出內容與 operator<< 一致。
+class ReportWriter
+{
+public:
+    explicit ReportWriter(std::ostream& out, size_t blockSize = 1 << 16)
+        : out(out), blockSize(blockSize)
+    {
+        buffer.reserve(blockSize + 64);
+    }
+
+    ~ReportWriter()
+    {
+        flush();
+    }
+
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+
+    ReportWriter& operator<<(std::string_view text)
+    {
+        if (text.size() >= blockSize) {
+            flush(); // 大段文字直接寫出，不經過緩衝區複製
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            return *this;
+        }
+        buffer.append(text.data(), text.size());
+        flushIfFull();
+        return *this;
+    }
+
+    ReportWriter& operator<<(const char* text)
+    {
+        return *this << std::string_view(text);
+    }
+
+    ReportWriter& operator<<(const std::string& text)
+    {
+        return *this << std::string_view(text);
+    }
+
+    ReportWriter& operator<<(char c)
+    {
+        buffer.push_back(c);
+        flushIfFull();
+        return *this;
+    }
+
+    ReportWriter& operator<<(int value)
+    {
+        return appendNumber(value);
+    }
+
+    ReportWriter& operator<<(long long value)
+    {
+        return appendNumber(value);
+    }
+
+    ReportWriter& operator<<(size_t value)
+    {
+        return appendNumber(value);
+    }
+
+    ReportWriter& operator<<(double value)
+    {
+        char digits[64];
+        auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+        if (ec != std::errc()) {
+            return *this << "nan";
+        }
+        buffer.append(digits, end);
+        flushIfFull();
+        return *this;
+    }
+
+    void flush()
+    {
+        if (!buffer.empty()) {
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+
+private:
+    template <typename Integer>
+    ReportWriter& appendNumber(Integer value)
+    {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr);
+        flushIfFull();
+        return *this;
+    }
+
+    void flushIfFull()
+    {
+        if (buffer.size() >= blockSize) {
+            flush();
+        }
+    }
+
+    std::ostream& out;
+    size_t blockSize;
+    std::string buffer;
+};
+
+void printMachineBatch(const std::vector<MachineBatch>& MachineBatchs, ReportWriter& outFile)
 {
     for (const auto& machineBatch : MachineBatchs)
     {
@@ -1197,6 +1671,12 @@ void printMachineBatch(const std::vector<MachineBatch> MachineBatchs, std::ofstr
     }
 }
 
+void printMachineBatch(const std::vector<MachineBatch>& MachineBatchs, std::ostream& outFile)
+{
+    ReportWriter writer(outFile);
+    printMachineBatch(MachineBatchs, writer);
+}
+
 double sumTotalWeightedDelay(const std::vector<MachineBatch>& machineBatches)
 {
     double total = 0.0;
@@ -1209,7 +1689,8 @@ double sumTotalWeightedDelay(const std::vector<MachineBatch>& machineBatches)
     return total;
 }
 
-void printDelayedBatches(const std::vector<DelayedBatch>& delayedBatches, std::ofstream& outFile) {
+void printDelayedBatches(const std::vector<DelayedBatch>& delayedBatches, std::ostream& out) {
+    ReportWriter outFile(out);
     outFile << "Delayed Batches:\n";
     for (const auto& delayedBatch : delayedBatches) {
         outFile << "MachineID: " << delayedBatch.MachineId << "\n";
@@ -1225,99 +1706,312 @@ void printDelayedBatches(const std::vector<DelayedBatch>& delayedBatches, std::o
     }
 }
 
-// 方法 1：交換兩個延遲批次
-void method1(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
-    // 随机数生成器初始化
-    std::cout << "12.3.1" << std::endl;
-    std::mt19937 rng(static_cast<unsigned int>(time(nullptr)));
-    std::cout << "12.3.2" << std::endl;
-    std::uniform_int_distribution<> distrib(0, machineBatches.size() - 1);
-    std::cout << "12.3.3" << std::endl;
-    // 随机选择两个不同的机器
-    int machineIndex1 = distrib(rng);
-    int machineIndex2 = distrib(rng);
-    while (machineIndex2 == machineIndex1) {
-        machineIndex2 = distrib(rng);
+// 目前執行緒已使用的 CPU 時間 (秒)
+double threadCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        return 0.0;
     }
-    std::cout << "12.3.4" << std::endl;
-    // 从每个机器中随机选择一个延迟批次
-    std::uniform_int_distribution<> distribBatch1(0, machineBatches[machineIndex1].delayedBatchInfo.size() - 1);
-    int batchIndex1 = distribBatch1(rng);
-    std::cout << "12.3.5" << std::endl;
-    std::uniform_int_distribution<> distribBatch2(0, machineBatches[machineIndex2].delayedBatchInfo.size() - 1);
-    int batchIndex2 = distribBatch2(rng);
-    std::cout << "12.3.6" << std::endl;
-    // 交换批次位置
-    if (machineIndex1 < machineBatches.size() && machineIndex2 < machineBatches.size()) {
-        if (batchIndex1 < machineBatches[machineIndex1].Batches.size() && batchIndex2 < machineBatches[machineIndex2].Batches.size()) {
-            // 安全地交换批次内容
-            std::swap(machineBatches[machineIndex1].Batches[batchIndex1], machineBatches[machineIndex2].Batches[batchIndex2]);
-        }
+    auto toSeconds = [](const FILETIME& ft) {
+        ULARGE_INTEGER value;
+        value.LowPart = ft.dwLowDateTime;
+        value.HighPart = ft.dwHighDateTime;
+        return static_cast<double>(value.QuadPart) * 1e-7; // 100ns 為單位
+    };
+    return toSeconds(kernelTime) + toSeconds(userTime);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0.0;
     }
-    std::cout << "12.3.7" << std::endl;
-
-    // 更新机器批次信息
-    updateMachineBatches(machineBatches[machineIndex1], sortedMachines);
-    updateMachineBatches(machineBatches[machineIndex2], sortedMachines);
-    std::cout << "12.3.8" << std::endl;
-
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
 }
 
-std::random_device rd; // 用於產生非確定性隨機數
-std::mt19937 rng(rd()); // 以隨機數種子初始化 Mersenne Twister 產生器
+// 配置計數：取代全域 operator new，以執行緒區域計數器記錄 heap 配置次數與位元組數。
+// 只有兩次整數遞增，一直開著也不影響量測。
+struct AllocationCounters
+{
+    unsigned long long Allocations = 0;
+    unsigned long long Bytes = 0;
+};
 
-void method2(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
-    std::vector<int> delayedBatchIndices;
-    std::vector<int> nonDelayedBatchIndices;
+thread_local AllocationCounters allocationCounters;
 
-    // 收集延遲和未延遲批次的索引
-    for (int i = 0; i < machineBatches.size(); ++i) {
-        for (int j = 0; j < machineBatches[i].Batches.size(); ++j) {
-            if (std::none_of(machineBatches[i].delayedBatchInfo.begin(), machineBatches[i].delayedBatchInfo.end(),
-                [j](const DelayedBatchInfo& dbi) { return dbi.BatchIndex == j; })) {
-                nonDelayedBatchIndices.push_back(i * 1000 + j); // 使用 i * 1000 + j 來唯一標識每個批次
-            }
-            else {
-                delayedBatchIndices.push_back(i * 1000 + j);
-            }
-        }
-    }
+// 整組一起取代 (陣列、nothrow 與 sized 版本都轉給同一對函式)，配置與釋放才會一致。
+// 釋放函式不內聯：GCC 內聯後會把 free 與呼叫端的 new 運算式配對而誤報 -Wmismatched-new-delete
+#if defined(_MSC_VER)
+#define ALLOCATION_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#define ALLOCATION_NOINLINE __attribute__((noinline))
+#else
+#define ALLOCATION_NOINLINE
+#endif
 
-    if (delayedBatchIndices.empty() || nonDelayedBatchIndices.empty()) {
-        std::cout << "沒有找到適合交換的批次。" << std::endl;
-        return;
+void* operator new(std::size_t size)
+{
+    allocationCounters.Allocations++;
+    allocationCounters.Bytes += size;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
     }
+    throw std::bad_alloc();
+}
 
-    // 隨機選擇一個延遲批次和一個未延遲批次
-    std::uniform_int_distribution<int> delayedDist(0, delayedBatchIndices.size() - 1);
-    std::uniform_int_distribution<int> nonDelayedDist(0, nonDelayedBatchIndices.size() - 1);
-
-    int delayedIndex = delayedBatchIndices[delayedDist(rng)];
-    int nonDelayedIndex = nonDelayedBatchIndices[nonDelayedDist(rng)];
-
-    int delayedMachineIndex = delayedIndex / 1000;
-    int delayedBatchIndex = delayedIndex % 1000;
-    int nonDelayedMachineIndex = nonDelayedIndex / 1000;
-    int nonDelayedBatchIndex = nonDelayedIndex % 1000;
-
-    // 進行交換
-    std::swap(machineBatches[delayedMachineIndex].Batches[delayedBatchIndex], machineBatches[nonDelayedMachineIndex].Batches[nonDelayedBatchIndex]);
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
 
-    // 更新機器批次
-    updateMachineBatches(machineBatches[delayedMachineIndex], sortedMachines);
-    updateMachineBatches(machineBatches[nonDelayedMachineIndex], sortedMachines);
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    allocationCounters.Allocations++;
+    allocationCounters.Bytes += size;
+    return std::malloc(size ? size : 1);
+}
 
-    std::cout << "成功交換並更新了批次。" << std::endl;
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return ::operator new(size, std::nothrow);
 }
 
+ALLOCATION_NOINLINE void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
 
-// 方法 3：從延遲批次中抽取任一零件，插入到其他可行位置中
-void method3(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
-    std::srand(std::time(nullptr)); // 初始化随机数生成器
+void operator delete[](void* p) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    ::operator delete(p);
+}
+
+// 時間軸記錄：輸出 Chrome trace-event JSON，可用 chrome://tracing 或 Perfetto 開啟。
+// 事件數超過上限後只計數不再保存，避免長時間求解把記憶體吃光。
+class TraceRecorder
+{
+public:
+    explicit TraceRecorder(size_t maxEvents = 1000000)
+        : origin(std::chrono::steady_clock::now()), maxEvents(maxEvents) {}
+
+    double nowMicros() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record(const char* name, const std::string& detail, double startMicros, double endMicros)
+    {
+        int tid = threadId();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (events.size() >= maxEvents) {
+            dropped++;
+            return;
+        }
+        events.push_back({ name, detail, tid, startMicros, endMicros - startMicros });
+    }
+
+    void setThreadName(const std::string& name)
+    {
+        int tid = threadId();
+        std::lock_guard<std::mutex> lock(mutex);
+        threadNames[tid] = name;
+    }
+
+    void write(const std::string& path) const
+    {
+        std::ofstream out(path);
+        if (!out) {
+            throw std::runtime_error("Cannot write trace file " + path);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << dropped << "},\"traceEvents\":[\n";
+        bool first = true;
+        for (const auto& entry : threadNames) {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << entry.first
+                << ",\"args\":{\"name\":" << json(entry.second).dump() << "}}";
+            first = false;
+        }
+        for (const auto& event : events) {
+            out << (first ? "" : ",\n") << "{\"name\":\"" << event.Name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.Tid
+                << ",\"ts\":" << event.Start << ",\"dur\":" << event.Duration;
+            if (!event.Detail.empty()) {
+                out << ",\"args\":{\"instance\":" << json(event.Detail).dump() << "}";
+            }
+            out << "}";
+            first = false;
+        }
+        out << "\n]}\n";
+    }
+
+    // 以註冊順序給每個執行緒一個小整數編號
+    static int threadId()
+    {
+        static std::atomic<int> nextId(1);
+        thread_local int id = nextId++;
+        return id;
+    }
+
+private:
+    struct Event
+    {
+        const char* Name;
+        std::string Detail;
+        int Tid;
+        double Start;
+        double Duration;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    size_t maxEvents;
+    mutable std::mutex mutex;
+    std::vector<Event> events;
+    std::map<int, std::string> threadNames;
+    long long dropped = 0;
+};
+
+// 由 --trace 設定；為 nullptr 時 TraceSpan 不做任何事
+TraceRecorder* activeTrace = nullptr;
+
+// RAII 區段：建構到解構之間記成一個完整事件
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name, std::string detail = std::string())
+        : name(name), detail(std::move(detail)), start(activeTrace ? activeTrace->nowMicros() : 0.0) {}
+
+    ~TraceSpan()
+    {
+        if (activeTrace) {
+            activeTrace->record(name, detail, start, activeTrace->nowMicros());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    std::string detail;
+    double start;
+};
+
+// 方法 1：交換兩個延遲批次
+bool method1(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, CounterRng& rng) {
+    std::cout << "12.3.1" << std::endl;
+    std::cout << "12.3.2" << std::endl;
+    if (machineBatches.size() < 2) {
+        return false;
+    }
+    std::uniform_int_distribution<> distrib(0, machineBatches.size() - 1);
+    std::cout << "12.3.3" << std::endl;
+    // 随机选择两个不同的机器
+    int machineIndex1 = distrib(rng);
+    int machineIndex2 = distrib(rng);
+    while (machineIndex2 == machineIndex1) {
+        machineIndex2 = distrib(rng);
+    }
+    std::cout << "12.3.4" << std::endl;
+    if (machineBatches[machineIndex1].delayedBatchInfo.empty() || machineBatches[machineIndex2].delayedBatchInfo.empty()) {
+        return false;
+    }
+    // 从每个机器中随机选择一个延迟批次
+    std::uniform_int_distribution<> distribBatch1(0, machineBatches[machineIndex1].delayedBatchInfo.size() - 1);
+    int batchIndex1 = distribBatch1(rng);
+    std::cout << "12.3.5" << std::endl;
+    std::uniform_int_distribution<> distribBatch2(0, machineBatches[machineIndex2].delayedBatchInfo.size() - 1);
+    int batchIndex2 = distribBatch2(rng);
+    std::cout << "12.3.6" << std::endl;
+    // 交换批次位置
+    bool swapped = false;
+    if (machineIndex1 < static_cast<int>(machineBatches.size()) && machineIndex2 < static_cast<int>(machineBatches.size())) {
+        if (batchIndex1 < static_cast<int>(machineBatches[machineIndex1].Batches.size()) && batchIndex2 < static_cast<int>(machineBatches[machineIndex2].Batches.size())) {
+            // 安全地交换批次内容
+            std::swap(machineBatches[machineIndex1].Batches[batchIndex1], machineBatches[machineIndex2].Batches[batchIndex2]);
+            swapped = true;
+        }
+    }
+    std::cout << "12.3.7" << std::endl;
+
+    // 更新机器批次信息
+    updateMachineBatches(machineBatches[machineIndex1], sortedMachines);
+    updateMachineBatches(machineBatches[machineIndex2], sortedMachines);
+    std::cout << "12.3.8" << std::endl;
+    return swapped;
+}
+
+bool method2(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, CounterRng& rng) {
+    std::vector<int> delayedBatchIndices;
+    std::vector<int> nonDelayedBatchIndices;
+
+    // 收集延遲和未延遲批次的索引
+    for (int i = 0; i < static_cast<int>(machineBatches.size()); ++i) {
+        for (int j = 0; j < static_cast<int>(machineBatches[i].Batches.size()); ++j) {
+            if (std::none_of(machineBatches[i].delayedBatchInfo.begin(), machineBatches[i].delayedBatchInfo.end(),
+                [j](const DelayedBatchInfo& dbi) { return dbi.BatchIndex == j; })) {
+                nonDelayedBatchIndices.push_back(i * 1000 + j); // 使用 i * 1000 + j 來唯一標識每個批次
+            }
+            else {
+                delayedBatchIndices.push_back(i * 1000 + j);
+            }
+        }
+    }
+
+    if (delayedBatchIndices.empty() || nonDelayedBatchIndices.empty()) {
+        std::cout << "沒有找到適合交換的批次。" << std::endl;
+        return false;
+    }
+
+    // 隨機選擇一個延遲批次和一個未延遲批次
+    std::uniform_int_distribution<int> delayedDist(0, delayedBatchIndices.size() - 1);
+    std::uniform_int_distribution<int> nonDelayedDist(0, nonDelayedBatchIndices.size() - 1);
+
+    int delayedIndex = delayedBatchIndices[delayedDist(rng)];
+    int nonDelayedIndex = nonDelayedBatchIndices[nonDelayedDist(rng)];
+
+    int delayedMachineIndex = delayedIndex / 1000;
+    int delayedBatchIndex = delayedIndex % 1000;
+    int nonDelayedMachineIndex = nonDelayedIndex / 1000;
+    int nonDelayedBatchIndex = nonDelayedIndex % 1000;
+
+    // 進行交換
+    std::swap(machineBatches[delayedMachineIndex].Batches[delayedBatchIndex], machineBatches[nonDelayedMachineIndex].Batches[nonDelayedBatchIndex]);
+
+    // 更新機器批次
+    updateMachineBatches(machineBatches[delayedMachineIndex], sortedMachines);
+    updateMachineBatches(machineBatches[nonDelayedMachineIndex], sortedMachines);
+
+    std::cout << "成功交換並更新了批次。" << std::endl;
+    return true;
+}
 
+
+// 方法 3：從延遲批次中抽取任一零件，插入到其他可行位置中
+bool method3(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, CounterRng& rng) {
     // 随机选择一个含有延迟零件的批次
     std::vector<int> delayedMachineIndices;
-    for (int i = 0; i < machineBatches.size(); ++i) {
+    for (int i = 0; i < static_cast<int>(machineBatches.size()); ++i) {
         if (!machineBatches[i].delayedBatchInfo.empty()) {
             delayedMachineIndices.push_back(i);
         }
@@ -1325,22 +2019,22 @@ void method3(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
 
     if (delayedMachineIndices.empty()) {
         std::cout << "没有找到含延遲零件的批次。" << std::endl;
-        return;
+        return false;
     }
 
-    int randomIndex = std::rand() % delayedMachineIndices.size();
+    int randomIndex = rng.index(delayedMachineIndices.size());
     int machineIndex = delayedMachineIndices[randomIndex];
     MachineBatch& selectedMachineBatch = machineBatches[machineIndex];
 
     // 从选中的批次中随机选择一个零件
-    int batchIndex = std::rand() % selectedMachineBatch.Batches.size();
+    int batchIndex = rng.index(selectedMachineBatch.Batches.size());
     Batch& selectedBatch = selectedMachineBatch.Batches[batchIndex];
     if (selectedBatch.parts.empty()) {
         std::cout << "選中的批次没有零件。" << std::endl;
-        return;
+        return false;
     }
 
-    int partIndex = std::rand() % selectedBatch.parts.size();
+    int partIndex = rng.index(selectedBatch.parts.size());
     PartTypeOrderInfo selectedPart = selectedBatch.parts[partIndex];
     selectedBatch.parts.erase(selectedBatch.parts.begin() + partIndex);
     // updateMachineBatches(selectedMachineBatch, sortedMachines);
@@ -1358,18 +2052,20 @@ void method3(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
         targetBatch.totalArea += selectedPart.partType->Area;
 
         updateMachineBatches(targetMachineBatch, sortedMachines);
+        updateMachineBatches(selectedMachineBatch, sortedMachines);
+        return true;
     }
-    else {
-        std::cout << "没有找到適合的插入位置。" << std::endl;
-    }
+
+    // 找不到位置時把零件放回原批次，不讓零件從排程中消失
+    std::cout << "没有找到適合的插入位置。" << std::endl;
+    selectedBatch.parts.insert(selectedBatch.parts.begin() + partIndex, selectedPart);
+    return false;
 }
 
 //方法 4: 從延遲批次中隨機抽取一批次，整批插入到隨機一未延遲批次 (要可行)
-void method4(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
-
+bool method4(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, CounterRng& rng) {
     std::vector<std::pair<int, int>> delayedBatchIndices;
-    for (int i = 0; i < machineBatches.size(); ++i) {
+    for (int i = 0; i < static_cast<int>(machineBatches.size()); ++i) {
         if (!machineBatches[i].delayedBatchInfo.empty()) {
             for (const auto& delayedInfo : machineBatches[i].delayedBatchInfo) {
                 delayedBatchIndices.push_back(std::make_pair(i, delayedInfo.BatchIndex));
@@ -1379,19 +2075,19 @@ void method4(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
 
     if (delayedBatchIndices.empty()) {
         std::cout << "没有找到含延遲批次。" << std::endl;
-        return;
+        return false;
     }
 
-    int randomIndex = std::rand() % delayedBatchIndices.size();
+    int randomIndex = rng.index(delayedBatchIndices.size());
     int delayedMachineIndex = delayedBatchIndices[randomIndex].first;
     int delayedBatchIndex = delayedBatchIndices[randomIndex].second;
     Batch& delayedBatch = machineBatches[delayedMachineIndex].Batches[delayedBatchIndex];
 
     std::vector<std::pair<int, int>> feasibleTargets;
-    for (int i = 0; i < machineBatches.size(); ++i) {
+    for (int i = 0; i < static_cast<int>(machineBatches.size()); ++i) {
         if (i != delayedMachineIndex) {
             double machineArea = sortedMachines[i].second.Area;
-            for (int j = 0; j < machineBatches[i].Batches.size(); ++j) {
+            for (int j = 0; j < static_cast<int>(machineBatches[i].Batches.size()); ++j) {
                 double usedArea = std::accumulate(machineBatches[i].Batches[j].parts.begin(), machineBatches[i].Batches[j].parts.end(), 0.0,
                     [](double sum, const PartTypeOrderInfo& partInfo) { return sum + partInfo.partType->Area; });
                 double availableArea = machineArea - usedArea;
@@ -1404,10 +2100,10 @@ void method4(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
 
     if (feasibleTargets.empty()) {
         std::cout << "没有找到适合的未延遲批次。" << std::endl;
-        return;
+        return false;
     }
 
-    randomIndex = std::rand() % feasibleTargets.size();
+    randomIndex = rng.index(feasibleTargets.size());
     int targetMachineIndex = feasibleTargets[randomIndex].first;
     int targetBatchIndex = feasibleTargets[randomIndex].second;
     Batch& targetBatch = machineBatches[targetMachineIndex].Batches[targetBatchIndex];
@@ -1422,16 +2118,15 @@ void method4(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
     // 更新机器批次信息
     updateMachineBatches(machineBatches[targetMachineIndex], sortedMachines);
     updateMachineBatches(machineBatches[delayedMachineIndex], sortedMachines);
+    return true;
 }
-//方法 5: 從延遲批次中抽取延遲最大的零件，插入到其他可行位置中
-void method5(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
-
+//方法 5: 從延遲批次中抽取延遲最大的零件，插入到其他可行位置中 (確定性，rng 只為了與其他方法同一個呼叫形式)
+bool method5(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, [[maybe_unused]] CounterRng& rng) {
     // 找出所有延遲零件，以及其對應的機器和批次索引
     std::vector<std::tuple<double, int, int, int>> delayedParts; // 儲存 (延遲時間，機器索引，批次索引，零件索引)
-    for (int machineIdx = 0; machineIdx < machineBatches.size(); ++machineIdx) {
-        for (int batchIdx = 0; batchIdx < machineBatches[machineIdx].Batches.size(); ++batchIdx) {
-            for (int partIdx = 0; partIdx < machineBatches[machineIdx].Batches[batchIdx].parts.size(); ++partIdx) {
+    for (int machineIdx = 0; machineIdx < static_cast<int>(machineBatches.size()); ++machineIdx) {
+        for (int batchIdx = 0; batchIdx < static_cast<int>(machineBatches[machineIdx].Batches.size()); ++batchIdx) {
+            for (int partIdx = 0; partIdx < static_cast<int>(machineBatches[machineIdx].Batches[batchIdx].parts.size()); ++partIdx) {
                 double delay = machineBatches[machineIdx].Batches[batchIdx].parts[partIdx].orderInfo.PenaltyCost;
                 delayedParts.emplace_back(delay, machineIdx, batchIdx, partIdx);
             }
@@ -1440,7 +2135,7 @@ void method5(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
 
     if (delayedParts.empty()) {
         std::cout << "没有找到含延遲零件的批次。" << std::endl;
-        return;
+        return false;
     }
 
     // 根据延遲時間排序，選取延遲最大的零件
@@ -1468,19 +2163,22 @@ void method5(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
 
         // 更新機器批次信息
         updateMachineBatches(targetMachineBatch, sortedMachines);
+        updateMachineBatches(machineBatches[machineIdx], sortedMachines);
+        return true;
     }
-    else {
-        std::cout << "没有找到適合的插入位置。" << std::endl;
-    }
+
+    // 找不到位置時把零件放回原批次，不讓零件從排程中消失
+    std::cout << "没有找到適合的插入位置。" << std::endl;
+    auto& sourceParts = machineBatches[machineIdx].Batches[batchIdx].parts;
+    sourceParts.insert(sourceParts.begin() + partIdx, selectedPart);
+    return false;
 }
 
 //方法 6: 從延遲批次中隨機抽取一批次，將其零件一一插入到其他所有可行位置中
-void method6(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
-
+bool method6(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, CounterRng& rng) {
     std::vector<std::pair<int, int>> delayedBatches; // 儲存 (機器索引，批次索引)
-    for (int machineIdx = 0; machineIdx < machineBatches.size(); ++machineIdx) {
-        for (int batchIdx = 0; batchIdx < machineBatches[machineIdx].Batches.size(); ++batchIdx) {
+    for (int machineIdx = 0; machineIdx < static_cast<int>(machineBatches.size()); ++machineIdx) {
+        for (int batchIdx = 0; batchIdx < static_cast<int>(machineBatches[machineIdx].Batches.size()); ++batchIdx) {
             if (!machineBatches[machineIdx].Batches[batchIdx].parts.empty()) {
                 delayedBatches.emplace_back(machineIdx, batchIdx);
             }
@@ -1489,11 +2187,11 @@ void method6(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
 
     if (delayedBatches.empty()) {
         std::cout << "没有找到含延遲批次。" << std::endl;
-        return;
+        return false;
     }
 
     // 隨機選擇一個批次
-    int randomIndex = std::rand() % delayedBatches.size();
+    int randomIndex = rng.index(delayedBatches.size());
     int machineIdx = delayedBatches[randomIndex].first;
     int batchIdx = delayedBatches[randomIndex].second;
     Batch& selectedBatch = machineBatches[machineIdx].Batches[batchIdx];
@@ -1502,7 +2200,8 @@ void method6(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
     auto partsToReallocate = selectedBatch.parts;
     selectedBatch.parts.clear(); // 清空原批次中的零件列表
 
-    // 對每個零件尋找新的插入位置
+    // 對每個零件尋找新的插入位置，找不到位置的零件留在原批次
+    bool movedAny = false;
     for (auto& part : partsToReallocate) {
         int bestMachineIndex = -1, bestBatchIndex = -1;
         std::tie(bestMachineIndex, bestBatchIndex) = findBestInsertionPosition(machineBatches, part, sortedMachines);
@@ -1512,46 +2211,158 @@ void method6(std::vector<MachineBatch>& machineBatches, const std::vector<std::p
             Batch& targetBatch = targetMachineBatch.Batches[bestBatchIndex];
 
             targetBatch.parts.push_back(part);
+            movedAny = movedAny || bestMachineIndex != machineIdx || bestBatchIndex != batchIdx;
 
             updateMachineBatches(targetMachineBatch, sortedMachines);
         }
         else {
             std::cout << "没有找到適合的插入位置。" << std::endl;
+            machineBatches[machineIdx].Batches[batchIdx].parts.push_back(part);
         }
     }
 
     updateMachineBatches(machineBatches[machineIdx], sortedMachines);
+    return movedAny;
+}
+
+
+// 運算子編號，用於遙測統計
+enum OperatorId
+{
+    OperatorStep2,
+    OperatorStep3,
+    OperatorStep4,
+    OperatorMethod1,
+    OperatorMethod2,
+    OperatorMethod3,
+    OperatorMethod4,
+    OperatorMethod5,
+    OperatorMethod6,
+    OperatorTabuSwap,
+    OperatorTabuRelocate,
+    OperatorTabuMerge,
+    OperatorCount
+};
+
+const char* const operatorNames[OperatorCount] = {
+    "step2", "step3", "step4", "method1", "method2", "method3", "method4", "method5", "method6",
+    "tabu_swap", "tabu_relocate", "tabu_merge"
+};
+
+// 一次運算子呼叫的成本
+struct OperatorCost
+{
+    double CpuSeconds = 0.0;
+    unsigned long long Allocations = 0;
+    unsigned long long Bytes = 0;
+};
+
+// 從 startCpu/startAlloc 到現在，本執行緒花費的 CPU 時間與 heap 配置
+OperatorCost costSince(double startCpu, const AllocationCounters& startAlloc)
+{
+    OperatorCost cost;
+    cost.CpuSeconds = threadCpuSeconds() - startCpu;
+    cost.Allocations = allocationCounters.Allocations - startAlloc.Allocations;
+    cost.Bytes = allocationCounters.Bytes - startAlloc.Bytes;
+    return cost;
 }
 
+// 單一步驟的執行結果
+struct StepOutcome
+{
+    double Result;             // 執行後的總加權延遲
+    bool Applied;              // false 表示運算子沒找到可做的變動 (no-op)
+    int Method;                // step4 選到的方法 (1–6)，其他步驟為 0
+    OperatorCost MethodCost;   // step4 中所選方法本身的成本
+};
+
+// ALNS 式的適應性方法選擇：以權重做輪盤選擇，每次呼叫依結果給分，
+// 每 SegmentLength 次選擇後以 w = (1 - r) w + r × (平均得分) 更新權重並清空得分。
+// 權重有下限，讓暫時沒用的方法仍有機會在後續被重新評估。
+class AdaptiveMethodSelector
+{
+public:
+    static constexpr int MethodCount = 6;
+    static constexpr int SegmentLength = 50;
+    static constexpr double ReactionFactor = 0.2;
+    static constexpr double MinimumWeight = 0.05;
+    // 得分：新的最佳解、改進目前解、接受較差的解 (多樣化)；沒有變動、目標值不變或被拒絕為 0
+    static constexpr double ScoreNewBest = 33.0;
+    static constexpr double ScoreImproved = 9.0;
+    static constexpr double ScoreAccepted = 13.0;
+
+    AdaptiveMethodSelector()
+    {
+        weights.fill(1.0);
+    }
+
+    // 回傳 1–6
+    int select(CounterRng& generator) const
+    {
+        std::discrete_distribution<int> distribution(weights.begin(), weights.end());
+        return distribution(generator) + 1;
+    }
+
+    void reward(int method, double score)
+    {
+        int index = method - 1;
+        scores[index] += score;
+        uses[index]++;
+        if (++segmentUses >= SegmentLength) {
+            for (int i = 0; i < MethodCount; i++) {
+                if (uses[i] > 0) {
+                    weights[i] = (1.0 - ReactionFactor) * weights[i] + ReactionFactor * scores[i] / uses[i];
+                }
+                weights[i] = std::max(weights[i], MinimumWeight);
+            }
+            scores.fill(0.0);
+            uses.fill(0);
+            segmentUses = 0;
+        }
+    }
+
+    const std::array<double, MethodCount>& currentWeights() const { return weights; }
+
+private:
+    std::array<double, MethodCount> weights;
+    std::array<double, MethodCount> scores{};
+    std::array<int, MethodCount> uses{};
+    int segmentUses = 0;
+};
 
-void executeRandomMethod(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
+StepOutcome executeRandomMethod(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines,
+    const AdaptiveMethodSelector& selector, CounterRng& rng) {
     std::cout << "12.1" << std::endl;
-    std::srand(std::time(nullptr)); // 使用當前時間作為隨機數生成器的種子
     std::cout << "12.2" << std::endl;
-    int method = std::rand() % 6 + 1;// 生成 1 至 6 之間的隨機數
+    int method = selector.select(rng);
 
     std::cout << "12.3" << std::endl;
 
+    bool applied = false;
+    double cpuStart = threadCpuSeconds();
+    AllocationCounters allocStart = allocationCounters;
+    TraceSpan span(operatorNames[OperatorMethod1 + method - 1]);
     switch (method) {
     case 1:
-        method1(machineBatches, sortedMachines);
+        applied = method1(machineBatches, sortedMachines, rng);
         break;
     case 2:
-        method2(machineBatches, sortedMachines);
+        applied = method2(machineBatches, sortedMachines, rng);
         break;
     case 3:
-        method3(machineBatches, sortedMachines);
+        applied = method3(machineBatches, sortedMachines, rng);
         break;
     case 4:
-        method4(machineBatches, sortedMachines);
+        applied = method4(machineBatches, sortedMachines, rng);
         break;
     case 5:
-        method5(machineBatches, sortedMachines);
+        applied = method5(machineBatches, sortedMachines, rng);
         break;
     case 6:
-        method6(machineBatches, sortedMachines);
+        applied = method6(machineBatches, sortedMachines, rng);
         break;
     }
+    return { 0.0, applied, method, costSince(cpuStart, allocStart) };
 }
 int calculateTotalSize(const std::map<int, std::vector<PartTypeOrderInfo>>& map) {
     int totalSize = 0;
@@ -1562,20 +2373,24 @@ int calculateTotalSize(const std::map<int, std::vector<PartTypeOrderInfo>>& map)
 }
 
 
-double step2(std::vector<MachineBatch>& tempMachineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
+StepOutcome step2(std::vector<MachineBatch>& tempMachineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, CounterRng& rng) {
+    TraceSpan span("step2");
     std::cout << "1" << std::endl;
-    std::vector<DelayedBatch> delayedBatchesList = extractAndRandomSelectDelayedBatches(tempMachineBatches, sortedMachines);
+    std::vector<DelayedBatch> delayedBatchesList = extractAndRandomSelectDelayedBatches(tempMachineBatches, sortedMachines, rng);
+    bool applied = !delayedBatchesList.empty();
     std::cout << "2" << std::endl;
     std::cout << "3" << std::endl;
     reintegrateDelayedBatches(tempMachineBatches, delayedBatchesList, sortedMachines);
     std::cout << "4" << std::endl;
     double currentResult = sumTotalWeightedDelay(tempMachineBatches);
-    return currentResult;
+    return { currentResult, applied, 0, OperatorCost() };
 }
 
-double step3(std::vector<MachineBatch>& tempMachineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
+StepOutcome step3(std::vector<MachineBatch>& tempMachineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines, CounterRng& rng) {
+    TraceSpan span("step3");
     std::cout << "5" << std::endl;
-    std::vector<PartTypeOrderInfo> extractedParts = extractAndRandomSelectParts(tempMachineBatches);
+    std::vector<PartTypeOrderInfo> extractedParts = extractAndRandomSelectParts(tempMachineBatches, rng);
+    bool applied = !extractedParts.empty();
     std::cout << "6" << std::endl;
     std::cout << "7" << std::endl;
     updateMachineBatchesAfterExtraction(tempMachineBatches, extractedParts, sortedMachines);
@@ -1585,14 +2400,16 @@ double step3(std::vector<MachineBatch>& tempMachineBatches, const std::vector<st
     std::cout << "10" << std::endl;
 
     double currentResult = sumTotalWeightedDelay(tempMachineBatches);
-    return currentResult;
+    return { currentResult, applied, 0, OperatorCost() };
 }
-double step4(std::vector<MachineBatch>& tempMachineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
+StepOutcome step4(std::vector<MachineBatch>& tempMachineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines,
+    const AdaptiveMethodSelector& selector, CounterRng& rng) {
+    TraceSpan span("step4");
     std::cout << "12" << std::endl;
-    executeRandomMethod(tempMachineBatches, sortedMachines);
+    StepOutcome outcome = executeRandomMethod(tempMachineBatches, sortedMachines, selector, rng);
     std::cout << "13" << std::endl;
-    double currentResult = sumTotalWeightedDelay(tempMachineBatches);
-    return currentResult;
+    outcome.Result = sumTotalWeightedDelay(tempMachineBatches);
+    return outcome;
 }
 
 std::vector<PartTypeOrderInfo> extractAndRemoveZeroPenaltyParts(std::vector<MachineBatch>& machineBatches, const std::vector<std::pair<int, Machine>>& sortedMachines) {
@@ -1627,217 +2444,3993 @@ std::vector<PartTypeOrderInfo> extractAndRemoveZeroPenaltyParts(std::vector<Mach
     return zeroPenaltyParts;
 }
 
+// 由檔名 Instance_o4_ipo10_m2_m3_pT30_ddr250_id4.json 解析出的實例族參數
+struct InstanceFamily
+{
+    int Orders = -1;
+    int ItemsPerOrder = -1;
+    int Machines = -1;
+    int Materials = -1;
+    int TardyPercent = -1;
+    int DueDateRange = -1;
+    int InstanceId = -1;
+};
+
+InstanceFamily parseInstanceFamily(const std::string& fileName)
+{
+    InstanceFamily family;
+    std::string name = fileName.substr(fileName.find_last_of("/\\") + 1);
+    name = name.substr(0, name.find('.'));
+
+    auto readNumber = [](const std::string& token, size_t prefixLength) {
+        try {
+            return std::stoi(token.substr(prefixLength));
+        }
+        catch (const std::exception&) {
+            return -1;
+        }
+    };
+
+    bool machinesSeen = false;
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find('_', start);
+        if (end == std::string::npos) end = name.size();
+        std::string token = name.substr(start, end - start);
+
+        if (token.rfind("ipo", 0) == 0) family.ItemsPerOrder = readNumber(token, 3);
+        else if (token.rfind("pT", 0) == 0) family.TardyPercent = readNumber(token, 2);
+        else if (token.rfind("ddr", 0) == 0) family.DueDateRange = readNumber(token, 3);
+        else if (token.rfind("id", 0) == 0) family.InstanceId = readNumber(token, 2);
+        else if (token.rfind("o", 0) == 0) family.Orders = readNumber(token, 1);
+        else if (token.rfind("m", 0) == 0) {
+            // 第一個 m 是機台數，第二個 m 是材料數
+            if (!machinesSeen) {
+                family.Machines = readNumber(token, 1);
+                machinesSeen = true;
+            }
+            else {
+                family.Materials = readNumber(token, 1);
+            }
+        }
+        start = end + 1;
+    }
+    return family;
+}
+
+// 收斂軌跡上的一點：目前最佳解每次改進時記錄
+struct ConvergencePoint
+{
+    double Seconds;       // 自求解開始的牆鐘時間
+    long long Iteration;
+    double Best;
+};
 
+// 硬體效能計數器量測的階段
+enum PerfPhase
+{
+    PerfConstruction,
+    PerfStep2,
+    PerfStep3,
+    PerfStep4,
+    PerfReport,
+    PerfPhaseCount
+};
 
+const char* const perfPhaseNames[PerfPhaseCount] = { "construction", "step2", "step3", "step4", "report" };
 
-void read_json(const std::string& file_path, std::ofstream& outFile, std::ofstream& allTestFile)
+// 一組計數器的讀值 (或兩次讀值的差)
+struct PerfSample
 {
-    std::ifstream file(file_path);
-    json j;
-    file >> j;
+    unsigned long long Cycles = 0;
+    unsigned long long Instructions = 0;
+    unsigned long long CacheMisses = 0;
+    unsigned long long BranchMisses = 0;
 
-    // 解析 Machines 部分
-    std::map<int, Machine> machines;
-    for (auto& kv : j["Machines"].items())
+    // 累加 end - begin
+    void accumulate(const PerfSample& begin, const PerfSample& end)
     {
-        int key = std::stoi(kv.key());
-        json value = kv.value();
-        Machine m;
-        m.MachineId = value["MachineId"];
-        m.Area = value["Area"];
-        m.Height = value["Height"];
-        m.Length = value["Length"];
-        m.Width = value["Width"];
-        for (auto& material : value["Materials"])
-        {
-            m.Materials.push_back(material);
-        }
-        for (auto& setup : value["MaterialSetup"])
-        {
-            m.MaterialSetup.push_back(setup.get<std::vector<double>>());
+        Cycles += end.Cycles - begin.Cycles;
+        Instructions += end.Instructions - begin.Instructions;
+        CacheMisses += end.CacheMisses - begin.CacheMisses;
+        BranchMisses += end.BranchMisses - begin.BranchMisses;
+    }
+};
+
+// Linux perf_event_open 計數器群組，只計算建立它的執行緒 (僅使用者空間)。
+// 開啟失敗 (非 Linux、perf_event_paranoid 限制、容器內) 時 available() 為 false，read() 回傳全零。
+class PerfCounters
+{
+public:
+    PerfCounters()
+    {
+#ifdef __linux__
+        const unsigned long long configs[4] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        int leader = -1;
+        for (int i = 0; i < 4; i++) {
+            perf_event_attr attr{};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = leader == -1 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+            if (fds[i] < 0) {
+                close();
+                return;
+            }
+            if (leader == -1) {
+                leader = fds[i];
+            }
         }
-        // Parsing the StartSetup as a vector of doubles
-        m.StartSetup = value["StartSetup"].get<std::vector<double>>();
-        // Parsing the ScanTime, RecoatTime, and RemovalTime
-        m.ScanTime = value["ScanTime"];
-        m.RecoatTime = value["RecoatTime"];
-        m.RemovalTime = value["RemovalTime"];
-        machines[key] = m;
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
     }
 
-    auto sortedMachines = sortMachines(machines); // 排序好的機器
+    ~PerfCounters() { close(); }
 
-    // 解析 PartTypes 部分
-    std::map<int, PartType> partTypes;
-    for (auto& kv : j["PartTypes"].items())
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const { return fds[0] >= 0; }
+
+    PerfSample read() const
     {
-        int key = std::stoi(kv.key());
-        json value = kv.value();
-        PartType p;
-        p.PartTypeId = key;
-        p.Height = value["Height"];
-        p.Length = value["Length"];
-        p.Width = value["Width"];
-        p.Area = value["Area"];
-        p.Volume = value["Volume"];
-        partTypes[key] = p;
+        PerfSample sample;
+#ifdef __linux__
+        if (!available()) {
+            return sample;
+        }
+        unsigned long long values[1 + 4] = {};
+        if (::read(fds[0], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)) || values[0] != 4) {
+            return sample;
+        }
+        sample.Cycles = values[1];
+        sample.Instructions = values[2];
+        sample.CacheMisses = values[3];
+        sample.BranchMisses = values[4];
+#endif
+        return sample;
     }
-    // 解析 Orders 部分
-    std::map<int, Order> orders;
-    std::map<int, std::vector<OrderDetail>> materialClassifiedOrderDetails;
-    for (auto& kv : j["Orders"].items())
+
+private:
+    void close()
     {
-        int key = std::stoi(kv.key());
-        json value = kv.value();
-        Order o;
-        o.OrderId = value["OrderId"];
-        o.DueDate = value["DueDate"];
-        o.ReleaseDate = value["ReleaseDate"];
-        o.PenaltyCost = value["PenaltyCost"];
-        for (auto& detailValue : value["OrderList"])
-        {
-            OrderDetail od;
-            int partTypeId = detailValue["PartType"];
-            od.partType = &partTypes[partTypeId]; // Reference to PartType structure
-            od.Quantity = detailValue["Quantity"];
-            od.Material = detailValue["Material"];
-            od.Quality = detailValue["Quality"];
-            od.OrderId = o.OrderId; // 设置 OrderId
-            materialClassifiedOrderDetails[od.Material].push_back(od);
-            o.OrderList.push_back(od);
+#ifdef __linux__
+        for (int& fd : fds) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
         }
-        orders[o.OrderId] = o;
+#endif
     }
 
-    auto sortedMaterials = sortMaterialClassifiedOrderDetails(materialClassifiedOrderDetails, orders, partTypes);
+    int fds[4] = { -1, -1, -1, -1 };
+};
 
-    auto finalSorted = generateFinalSortedPartTypes(sortedMaterials, orders, partTypes);
-    auto machineBatches = createMachineBatches(finalSorted, sortedMachines);
+// 單一運算子的遙測計數
+struct OperatorStats
+{
+    long long Invocations = 0;
+    long long NoOps = 0;              // 沒有找到可做的變動就返回
+    long long Improving = 0;          // 執行後總加權延遲下降
+    long long AcceptedWorsening = 0;  // 變差但仍被接受 (僅 step4)
+    double DeltaSum = 0.0;            // 執行前後總加權延遲差的總和
+    double CpuSeconds = 0.0;
+    unsigned long long Allocations = 0;
+    unsigned long long Bytes = 0;
+
+    double meanDelta() const { return Invocations > 0 ? DeltaSum / Invocations : 0.0; }
+};
 
-    printMachineBatch(machineBatches, outFile);
+// 改善階段使用的搜尋引擎
+enum class SearchEngine
+{
+    Annealing, // step2/step3/step4 迴圈，第四步以模擬退火接受
+    Tabu,      // 整批交換、零件搬移、批次合併的禁忌搜尋
+    Exact      // 分支定界，證明最佳解或回報剩餘差距
+};
 
-    outFile << "----------------------------------" << "\n";
-    double result = sumTotalWeightedDelay(machineBatches);
-    outFile << "  初始解 : " << result << "\n"; //step 6.
-    outFile << "----------------------------------" << "\n";
+const char* searchEngineName(SearchEngine engine)
+{
+    switch (engine) {
+    case SearchEngine::Annealing: return "annealing";
+    case SearchEngine::Tabu: return "tabu";
+    case SearchEngine::Exact: return "exact";
+    }
+    return "unknown";
+}
 
-    int machineSize = sortedMachines.size();
-    int partSize = calculateTotalSize(finalSorted);
+SearchEngine parseSearchEngine(const std::string& name)
+{
+    if (name == "annealing") {
+        return SearchEngine::Annealing;
+    }
+    if (name == "tabu") {
+        return SearchEngine::Tabu;
+    }
+    if (name == "exact") {
+        return SearchEngine::Exact;
+    }
+    throw std::invalid_argument("Unknown search engine: " + name);
+}
 
-    //如果零件懲罰權重為零，就一定放在最後做 (就是等演算法結束，最後再把它隨便插回去)
-    // auto extractedParts = extractAndRemoveZeroPenaltyParts(machineBatches, sortedMachines);
+// 搜尋迴圈結束的原因
+enum class StopReason
+{
+    IterationBudget, // 跑完 machineSize * partSize * 45 次迭代
+    ZeroObjective,   // 總加權延遲已為 0，不可能再改進
+    Deadline,        // 超過 --instance-time 的單一實例時限
+    Stalled,         // 連續 --stall-iters 次迭代沒有改進
+    LowImprovementRate, // 最近 --rate-window 次迭代的相對改進低於 --min-improvement
+    ReachedLowerBound,  // 最佳解已等於下界，不可能再改進
+    ProvenOptimal,      // 分支定界走完整棵樹
+    NodeLimit           // 分支定界達到 --exact-nodes 的節點上限
+};
 
-    auto bestMachineBatches = machineBatches;
-    double bestResult = result; // 這裡使用深拷貝以確保完全獨立
+const char* stopReasonName(StopReason reason)
+{
+    switch (reason) {
+    case StopReason::IterationBudget: return "iteration_budget";
+    case StopReason::ZeroObjective: return "zero_objective";
+    case StopReason::Deadline: return "deadline";
+    case StopReason::Stalled: return "stalled";
+    case StopReason::LowImprovementRate: return "low_improvement_rate";
+    case StopReason::ReachedLowerBound: return "reached_lower_bound";
+    case StopReason::ProvenOptimal: return "proven_optimal";
+    case StopReason::NodeLimit: return "node_limit";
+    }
+    return "unknown";
+}
 
-    if (result != 0) {
+// 單一實例求解的統計資料，供結構化輸出使用
+struct SolveStats
+{
+    std::string InstanceName;
+    InstanceFamily Family;
+    double InitialResult = 0.0;
+    double BestResult = 0.0;
+    long long Iterations = 0;
+    long long AcceptedMoves = 0;
+    double WallSeconds = 0.0;
+    double CpuSeconds = 0.0;
+    long long PeakRssKb = 0;
+
+    double LowerBound = 0.0;
+    long long IterationBudget = 0;      // 0 表示由時限決定 (--instance-time)
+    StopReason Stop = StopReason::IterationBudget;
+    std::vector<ConvergencePoint> Trace;
+    double TimeToWithin1Percent = 0.0;  // 第一次達到最終值 1% 以內的時間
+    double TimeToWithin5Percent = 0.0;
+    double LastImprovementSeconds = 0.0;
+    long long LastImprovementIteration = 0;
+
+    // 最佳解與下界的相對差距 (best - LB) / best；最佳解為 0 時差距為 0
+    double gap() const { return BestResult > 0 ? (BestResult - LowerBound) / BestResult : 0.0; }
+
+    std::array<OperatorStats, OperatorCount> Operators{};
+    std::array<double, 6> MethodWeights{};     // 結束時 method1–method6 的適應性選擇權重
+    double InitialTemperature = 0.0;           // 模擬退火校準後的起始溫度
+    double FinalTemperature = 0.0;
+    int Reheats = 0;
+    std::uint64_t Seed = 0;                    // --seed 的值
+    std::uint64_t RngStream = 0;               // 由種子與實例名稱導出的串流 key
+    long long TranspositionLookups = 0;
+    long long TranspositionHits = 0;           // 候選排程先前已訪問過的次數
+    long long RevisitsRejected = 0;            // 第四步因重複訪問而拒絕的移動
+    SearchEngine Engine = SearchEngine::Annealing;
+    long long TabuEvaluations = 0;             // 禁忌搜尋評估過的移動數
+    long long TabuRejected = 0;                // 因禁忌而排除的候選移動
+    long long TabuAspirations = 0;             // 禁忌但優於最佳解而被採用的移動
+    long long TabuTenure = 0;
+    long long ExactNodes = 0;                  // 分支定界展開的節點數
+    bool ExactOptimal = false;                 // 分支定界是否證明了最佳解
+    int ResequencedMachines = 0;               // 建構後與搜尋結束時批次重排改變了順序的機台數
+    double ResequenceGain = 0.0;               // 搜尋結束時批次重排減少的總加權延遲
+    unsigned long long SearchAllocations = 0;  // 搜尋迴圈內的 heap 配置 (不含建構與報告)
+    unsigned long long SearchBytes = 0;
+
+    double allocationsPerIteration() const { return Iterations > 0 ? static_cast<double>(SearchAllocations) / Iterations : 0.0; }
+    double bytesPerIteration() const { return Iterations > 0 ? static_cast<double>(SearchBytes) / Iterations : 0.0; }
+
+    bool PerfEnabled = false;  // 以 --perf-counters 要求且計數器可用時為 true
+    std::array<PerfSample, PerfPhaseCount> Perf{};
+};
 
-        auto tempMachineBatches = bestMachineBatches;
+// 依收斂軌跡計算達到最終值 1%/5% 以內的時間與最後一次改進的位置
+void summarizeConvergence(SolveStats& stats)
+{
+    auto timeToWithin = [&](double fraction) {
+        double target = stats.BestResult + std::abs(stats.BestResult) * fraction + 1e-9;
+        for (const auto& point : stats.Trace) {
+            if (point.Best <= target) {
+                return point.Seconds;
+            }
+        }
+        return stats.WallSeconds;
+    };
+
+    stats.TimeToWithin1Percent = timeToWithin(0.01);
+    stats.TimeToWithin5Percent = timeToWithin(0.05);
+    if (!stats.Trace.empty()) {
+        stats.LastImprovementSeconds = stats.Trace.back().Seconds;
+        stats.LastImprovementIteration = stats.Trace.back().Iteration;
+    }
+}
 
-        for (int i = 0;i < machineSize * partSize * 45;i++) {
-            if (bestResult != 0) {
-                double currentResult = step2(tempMachineBatches, sortedMachines);
+// 行程的最高常駐記憶體 (KB)
+long long peakRssKb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return static_cast<long long>(counters.PeakWorkingSetSize / 1024);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<long long>(usage.ru_maxrss / 1024); // macOS 以 byte 為單位
+#else
+    return static_cast<long long>(usage.ru_maxrss);
+#endif
+#endif
+}
 
-                if (currentResult < bestResult) {
-                    bestMachineBatches = tempMachineBatches;
-                    bestResult = currentResult;
-                    outFile << "第二步改進的解 : " << bestResult << "\n";
-                }
-                else {
-                    outFile << "第二步保留之前的最佳解，當前解：" << currentResult << "\n";
-                }
+// 結構化結果輸出 (JSONL 或 CSV，依副檔名決定)，每個實例一行
+class ResultsSink
+{
+public:
+    enum class Format { Jsonl, Csv };
 
-                if (currentResult == 0) {
-                    continue; // 如果第二步結果為 0，跳過後續步驟
-                }
+    explicit ResultsSink(const std::string& path)
+        : out(path), format(Format::Jsonl), headerWritten(false)
+    {
+        std::string lower = path;
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (lower.size() >= 4 && lower.compare(lower.size() - 4, 4, ".csv") == 0) {
+            format = Format::Csv;
+        }
+        if (!out) {
+            throw std::runtime_error("Cannot open results file " + path);
+        }
+    }
 
-                // 進行第三步之前，基於當前最佳解（可能是從第一步或第二步保留下來的）
-                tempMachineBatches = bestMachineBatches; // 確保第三步基於當前最佳解
-                double currentResult2 = step3(tempMachineBatches, sortedMachines);
+    void write(const SolveStats& stats)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (format == Format::Csv) {
+            writeCsv(stats);
+        }
+        else {
+            writeJsonl(stats);
+        }
+        out.flush();
+    }
 
-                if (currentResult2 < bestResult) {
-                    bestMachineBatches = tempMachineBatches; // 如果第三步改進，更新最佳解
-                    bestResult = currentResult2;
-                    outFile << "第三步改進的解 : " << bestResult << "\n";
-                }
-                else {
-                    outFile << "第三步保留之前的最佳解，當前解：" << currentResult2 << "\n";
-                }
+private:
+    void writeJsonl(const SolveStats& stats)
+    {
+        json row;
+        row["instance"] = stats.InstanceName;
+        row["orders"] = stats.Family.Orders;
+        row["items_per_order"] = stats.Family.ItemsPerOrder;
+        row["machines"] = stats.Family.Machines;
+        row["materials"] = stats.Family.Materials;
+        row["tardy_percent"] = stats.Family.TardyPercent;
+        row["due_date_range"] = stats.Family.DueDateRange;
+        row["instance_id"] = stats.Family.InstanceId;
+        row["initial_objective"] = stats.InitialResult;
+        row["best_objective"] = stats.BestResult;
+        row["lower_bound"] = stats.LowerBound;
+        row["gap"] = stats.gap();
+        row["iterations"] = stats.Iterations;
+        row["accepted_moves"] = stats.AcceptedMoves;
+        row["wall_seconds"] = stats.WallSeconds;
+        row["cpu_seconds"] = stats.CpuSeconds;
+        row["peak_rss_kb"] = stats.PeakRssKb;
+        row["iteration_budget"] = stats.IterationBudget;
+        row["stop_reason"] = stopReasonName(stats.Stop);
+        row["time_to_1pct"] = stats.TimeToWithin1Percent;
+        row["time_to_5pct"] = stats.TimeToWithin5Percent;
+        row["last_improvement_seconds"] = stats.LastImprovementSeconds;
+        row["last_improvement_iteration"] = stats.LastImprovementIteration;
+        row["search_allocations"] = stats.SearchAllocations;
+        row["search_allocated_bytes"] = stats.SearchBytes;
+        row["allocations_per_iteration"] = stats.allocationsPerIteration();
+        row["bytes_per_iteration"] = stats.bytesPerIteration();
+        json trace = json::array();
+        for (const auto& point : stats.Trace) {
+            trace.push_back({ point.Seconds, point.Iteration, point.Best });
+        }
+        row["trace"] = trace;
+        json operators = json::object();
+        for (int id = 0; id < OperatorCount; id++) {
+            const OperatorStats& op = stats.Operators[id];
+            operators[operatorNames[id]] = {
+                {"invocations", op.Invocations},
+                {"no_ops", op.NoOps},
+                {"improving", op.Improving},
+                {"accepted_worsening", op.AcceptedWorsening},
+                {"mean_delta", op.meanDelta()},
+                {"cpu_seconds", op.CpuSeconds},
+                {"allocations", op.Allocations},
+                {"allocated_bytes", op.Bytes}
+            };
+        }
+        row["operators"] = operators;
+        row["method_weights"] = stats.MethodWeights;
+        row["initial_temperature"] = stats.InitialTemperature;
+        row["final_temperature"] = stats.FinalTemperature;
+        row["reheats"] = stats.Reheats;
+        row["seed"] = stats.Seed;
+        row["transposition_lookups"] = stats.TranspositionLookups;
+        row["transposition_hits"] = stats.TranspositionHits;
+        row["revisits_rejected"] = stats.RevisitsRejected;
+        row["resequence"] = {
+            { "machines", stats.ResequencedMachines },
+            { "gain", stats.ResequenceGain }
+        };
+        row["engine"] = searchEngineName(stats.Engine);
+        if (stats.Engine == SearchEngine::Exact) {
+            row["exact"] = {
+                { "nodes", stats.ExactNodes },
+                { "optimal", stats.ExactOptimal }
+            };
+        }
+        if (stats.Engine == SearchEngine::Tabu) {
+            row["tabu"] = {
+                { "evaluations", stats.TabuEvaluations },
+                { "rejected", stats.TabuRejected },
+                { "aspirations", stats.TabuAspirations },
+                { "tenure", stats.TabuTenure }
+            };
+        }
+        row["rng_stream"] = stats.RngStream;
+        if (stats.PerfEnabled) {
+            json perf = json::object();
+            for (int phase = 0; phase < PerfPhaseCount; phase++) {
+                const PerfSample& sample = stats.Perf[phase];
+                perf[perfPhaseNames[phase]] = {
+                    {"cycles", sample.Cycles},
+                    {"instructions", sample.Instructions},
+                    {"cache_misses", sample.CacheMisses},
+                    {"branch_misses", sample.BranchMisses}
+                };
+            }
+            row["perf"] = perf;
+        }
+        out << row.dump() << "\n";
+    }
 
-                if (currentResult2 == 0) {
-                    continue; // 如果第三步結果為 0，跳過後續步驟
-                }
+    void writeCsv(const SolveStats& stats)
+    {
+        if (!headerWritten) {
+            out << "instance,orders,items_per_order,machines,materials,tardy_percent,due_date_range,instance_id,"
+                "initial_objective,best_objective,iterations,accepted_moves,wall_seconds,cpu_seconds,peak_rss_kb,"
+                "iteration_budget,time_to_1pct,time_to_5pct,last_improvement_seconds,last_improvement_iteration,"
+                "allocations_per_iteration,bytes_per_iteration,stop_reason,lower_bound,gap,seed,engine\n";
+            headerWritten = true;
+        }
+        out << stats.InstanceName << ","
+            << stats.Family.Orders << ","
+            << stats.Family.ItemsPerOrder << ","
+            << stats.Family.Machines << ","
+            << stats.Family.Materials << ","
+            << stats.Family.TardyPercent << ","
+            << stats.Family.DueDateRange << ","
+            << stats.Family.InstanceId << ","
+            << stats.InitialResult << ","
+            << stats.BestResult << ","
+            << stats.Iterations << ","
+            << stats.AcceptedMoves << ","
+            << stats.WallSeconds << ","
+            << stats.CpuSeconds << ","
+            << stats.PeakRssKb << ","
+            << stats.IterationBudget << ","
+            << stats.TimeToWithin1Percent << ","
+            << stats.TimeToWithin5Percent << ","
+            << stats.LastImprovementSeconds << ","
+            << stats.LastImprovementIteration << ","
+            << stats.allocationsPerIteration() << ","
+            << stats.bytesPerIteration() << ","
+            << stopReasonName(stats.Stop) << ","
+            << stats.LowerBound << ","
+            << stats.gap() << ","
+            << stats.Seed << ","
+            << searchEngineName(stats.Engine) << "\n";
+    }
+
+    std::ofstream out;
+    Format format;
+    bool headerWritten;
+    std::mutex writeMutex;
+};
+
+// 排程序列化格式 (每台機台一行 M，每個批次一行 B，零件依位置排列為 零件類型:訂單)：
+//   schedule 1
+//   M <MachineId>
+//   B <materialType> <PartTypeId>:<OrderId> <PartTypeId>:<OrderId> ...
+const char* const scheduleFormatHeader = "schedule 1";
+
+void writeSchedule(const std::vector<MachineBatch>& machineBatches, std::ostream& out)
+{
+    out << scheduleFormatHeader << "\n";
+    for (const auto& machineBatch : machineBatches) {
+        out << "M " << machineBatch.MachineId << "\n";
+        for (const auto& batch : machineBatch.Batches) {
+            out << "B " << batch.materialType;
+            for (const auto& part : batch.parts) {
+                out << " " << part.partType->PartTypeId << ":" << part.orderInfo.OrderId;
+            }
+            out << "\n";
+        }
+    }
+}
+
+// 讀回排程並對應到目前實例的零件。存檔中已不存在的零件會被略過，
+// 存檔中沒有的新零件則以 sortAndInsertParts 插入，因此實例稍有變動時也能熱啟動。
+std::vector<MachineBatch> loadSchedule(std::istream& in,
+    const std::map<int, std::vector<PartTypeOrderInfo>>& sortedMaterials,
+    const std::vector<std::pair<int, Machine>>& sortedMachines)
+{
+    std::string line;
+    if (!std::getline(in, line) || line != scheduleFormatHeader) {
+        throw std::runtime_error("Unsupported schedule format.");
+    }
+
+    // 依 (材料, 零件類型, 訂單) 分組的可用零件
+    std::map<std::tuple<int, int, int>, std::vector<PartTypeOrderInfo>> pool;
+    for (const auto& materialEntry : sortedMaterials) {
+        for (const auto& partInfo : materialEntry.second) {
+            pool[std::make_tuple(partInfo.Material, partInfo.partType->PartTypeId, partInfo.orderInfo.OrderId)].push_back(partInfo);
+        }
+    }
+
+    std::vector<MachineBatch> machineBatches;
+    machineBatches.reserve(sortedMachines.size());
+    for (const auto& machinePair : sortedMachines) {
+        machineBatches.emplace_back(MachineBatch{
+            machinePair.first,
+            machinePair.second.Area,
+            0.0, // RunningTime
+            0.0  // TotalWeightedDelay
+            });
+    }
 
-                tempMachineBatches = bestMachineBatches;
-                double currentResult3 = step4(tempMachineBatches, sortedMachines);
+    MachineBatch* currentMachine = nullptr;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+
+        std::istringstream fields(line);
+        std::string tag;
+        fields >> tag;
+
+        if (tag == "M") {
+            int machineId;
+            if (!(fields >> machineId)) {
+                throw std::runtime_error("Malformed schedule line: " + line);
+            }
+            int machineIndex = findMachineBatchIndexByMachineId(machineBatches, machineId);
+            currentMachine = machineIndex >= 0 ? &machineBatches[machineIndex] : nullptr;
+        }
+        else if (tag == "B") {
+            Batch batch;
+            batch.batchId = currentBatchId++;
+            batch.totalArea = 0.0;
+            if (!(fields >> batch.materialType)) {
+                throw std::runtime_error("Malformed schedule line: " + line);
+            }
 
-                srand(static_cast<unsigned>(time(0)));
-                double random_prob = static_cast<double>(rand()) / RAND_MAX;
+            std::string partToken;
+            while (fields >> partToken) {
+                size_t separator = partToken.find(':');
+                if (separator == std::string::npos) {
+                    throw std::runtime_error("Malformed part entry: " + partToken);
+                }
+                int partTypeId = std::stoi(partToken.substr(0, separator));
+                int orderId = std::stoi(partToken.substr(separator + 1));
 
-                double m = ((currentResult3 - bestResult) / bestResult) * -100;
-                double e_power_m = std::exp(m);
-                if (currentResult3 < bestResult || random_prob <= e_power_m) {
-                // if (currentResult3 < bestResult || 0 <= e_power_m && e_power_m <= 1) {
-                    bestMachineBatches = tempMachineBatches; // 如果第四步改進，更新最佳解
-                    bestResult = currentResult3;
-                    outFile << "第四步改進的解 : " << bestResult << "\n";
+                auto poolIt = pool.find(std::make_tuple(batch.materialType, partTypeId, orderId));
+                if (currentMachine == nullptr || poolIt == pool.end() || poolIt->second.empty()) {
+                    continue; // 機台或零件已不在此實例中
                 }
-                else {
-                    outFile << "第四步保留之前的最佳解，當前解：" << currentResult3 << "\n";
+                PartTypeOrderInfo partInfo = poolIt->second.back();
+                if (batch.totalArea + partInfo.partType->Area > currentMachine->MachineArea) {
+                    continue; // 機台面積改變後放不下，留給後面重新插入
                 }
+                poolIt->second.pop_back();
+                partInfo.machineID = currentMachine->MachineId;
+                partInfo.batchId = batch.batchId;
+                batch.parts.push_back(partInfo);
+                batch.totalArea += partInfo.partType->Area;
+            }
+
+            if (currentMachine != nullptr && !batch.parts.empty()) {
+                currentMachine->Batches.push_back(batch);
             }
         }
+        else {
+            throw std::runtime_error("Malformed schedule line: " + line);
+        }
     }
 
-    // sortAndInsertParts(bestMachineBatches, sortedMachines, extractedParts); 把零件權重 0 的放回去
-    // bestResult = sumTotalWeightedDelay(bestMachineBatches);
+    for (auto& machineBatch : machineBatches) {
+        updateMachineBatches(machineBatch, sortedMachines);
+    }
+
+    std::vector<PartTypeOrderInfo> remainingParts;
+    for (auto& entry : pool) {
+        for (auto& partInfo : entry.second) {
+            partInfo.batchId = currentBatchId++;
+            remainingParts.push_back(partInfo);
+        }
+    }
+    if (!remainingParts.empty()) {
+        sortAndInsertParts(machineBatches, sortedMachines, remainingParts);
+    }
 
+    return machineBatches;
+}
 
-    outFile << "**********************************" << "\n";
-    printMachineBatch(bestMachineBatches, outFile);
-    outFile << "結果 : " << "\n";
-    outFile << "  初始解 : " << result << "\n";
-    outFile << "  最佳解 : " << bestResult << "\n";
-    outFile << "**********************************" << "\n";
+// 單一實例的求解選項
+struct SolveOptions
+{
+    std::string saveScheduleDir; // 非空時將最佳排程寫到 <dir>/<實例名稱>.schedule
+    std::string warmStartDir;    // 非空且存在對應檔案時，從該排程開始搜尋
+    bool perfCounters = false;   // 以 perf_event_open 量測各階段的硬體計數器
+    double instanceTimeSeconds = 0.0; // 大於 0 時每個實例搜尋到此時限 (含建構) 為止，取代固定迭代次數
+    long long stallIterations = 0;    // 大於 0 時連續這麼多次迭代沒有改進就停止
+    long long rateWindow = 0;         // 改進率的滑動視窗 (迭代數)，與 minImprovementRate 一起使用
+    double minImprovementRate = 0.0;  // 視窗內最佳解的相對改進低於此比例就停止
+    long long reheatAfter = 0;        // 最佳解停滯多少次迭代後回溫，0 表示依迭代預算自動決定
+    std::uint64_t seed = 1;           // 亂數種子；每個實例的串流由種子與實例名稱導出
+    size_t transpositionEntries = 1 << 16; // 置換表容量 (進位到 2 的冪次)，0 表示停用
+    SearchEngine engine = SearchEngine::Annealing;
+    long long tabuTenure = 0;         // 禁忌期 (迭代數)，0 表示依零件數與機台數自動決定
+    int tabuSamples = 64;             // 禁忌搜尋每次迭代抽樣評估的移動數
+    long long exactNodeLimit = 20000000; // 分支定界的節點上限
+    int exactThreads = 1;             // 每個實例分支定界的執行緒數；支配表各執行緒獨立，加上 --threads 個求解執行緒容易超額使用 CPU
+    int resequenceThreshold = 16;     // 批次數不超過此值的機台以位元遮罩 DP 重排，其餘用相鄰交換 (上限 MaxResequenceBatches)
+};
 
-    allTestFile << "檔案 名稱：" << file_path.substr(file_path.find_last_of("/\\") + 1) << "\n";
-    allTestFile << "  初始解 : " << result << "\n";
-    allTestFile << "  最佳解 : " << bestResult << "\n";
+std::string scheduleFilePath(const std::string& directory, const std::string& instanceName)
+{
+    return directory + "/" + instanceName + ".schedule";
 }
 
 
-int main() {
-    WIN32_FIND_DATAA findFileData;
-    // HANDLE hFind = FindFirstFileA("C:/Users/2200555.SYSTEX/Documents/Project/test/*.json", &findFileData);
-    // std::ofstream allTestFile("C:/Users/2200555.SYSTEX/Documents/Project/output/allTest.txt"); // 全局結果文件
+// 總加權延遲的下界 (與 updateMachineBatches 相同，不含換料時間)，載入實例後計算一次。
+// 1. 單一零件：零件所在批次至少要花 Volume × ScanTime + Height × RecoatTime，取最快的機台，
+//    因此每個零件的延遲至少是 w × (最短加工時間 - 交期)+。
+// 2. 單機鬆弛：把所有機台合併成一台掃描速率為 Σ 1/ScanTime 的機台 (忽略鋪粉與批次)，
+//    對任一零件子集合 S，Σ_S w × T ≥ Σ_S w × C - Σ_S w × d，而 Σ_S w × C 的最小值由 WSPT 排序達到；
+//    S 以外的零件仍套用第 1 項。S 從全部零件開始，反覆移除 WSPT 完工早於交期的零件，取過程中的最大值。
+// 下界計算中的一個零件
+struct LowerBoundItem
+{
+    double Weight;
+    double DueDate;
+    double Work;            // 合併機台上的加工時間
+    double SinglePartBound; // 第 1 項的延遲下界
+};
 
-    HANDLE hFind = FindFirstFileA("C:/Users/USER/Desktop/Project-main/test/*.json", &findFileData);
-    std::ofstream allTestFile("C:/Users/USER/Desktop/Project-main/output/allTest.txt"); // 全局結果文件
+// 第 2 項的子集合鬆弛 (已含第 1 項)。items 會依 WSPT 重新排序
+double wsptSubsetBound(std::vector<LowerBoundItem>& items)
+{
+    // WSPT：w / p 由大到小；p 為 0 且有權重的零件排最前面
+    auto ratio = [](const LowerBoundItem& item) {
+        return item.Work > 0 ? item.Weight / item.Work
+            : (item.Weight > 0 ? std::numeric_limits<double>::infinity() : 0.0);
+    };
+    std::stable_sort(items.begin(), items.end(), [&](const LowerBoundItem& a, const LowerBoundItem& b) {
+        return ratio(a) > ratio(b);
+        });
 
-    if (hFind == INVALID_HANDLE_VALUE) {
-        std::cerr << "FindFirstFile failed\n";
-        return 1;
+    double best = 0.0;
+    for (const auto& item : items) {
+        best += item.SinglePartBound;
     }
-    else {
-        do {
-            std::string jsonFileName = std::string(findFileData.cFileName);
-            // std::string fullPath = "C:/Users/2200555.SYSTEX/Documents/Project/test/" + jsonFileName;
-            // std::string outputFileName = "C:/Users/2200555.SYSTEX/Documents/Project/output/output_" + jsonFileName + ".txt";
+    std::vector<char> inSubset(items.size(), 1);
+    while (true) {
+        double completion = 0.0, relaxed = 0.0, outside = 0.0;
+        bool removed = false;
+        std::vector<char> keep = inSubset;
+        for (size_t index = 0; index < items.size(); index++) {
+            const LowerBoundItem& item = items[index];
+            if (!inSubset[index]) {
+                outside += item.SinglePartBound;
+                continue;
+            }
+            completion += item.Work;
+            relaxed += item.Weight * (completion - item.DueDate);
+            if (completion < item.DueDate && item.Weight > 0) {
+                keep[index] = 0;
+                removed = true;
+            }
+        }
+        best = std::max(best, relaxed + outside);
+        if (!removed) {
+            break;
+        }
+        inSubset.swap(keep);
+    }
+    return best;
+}
 
-            std::string fullPath = "C:/Users/USER/Desktop/Project-main/test/" + jsonFileName;
-            std::string outputFileName = "C:/Users/USER/Desktop/Project-main/output/output_" + jsonFileName + ".txt";
+double computeLowerBound(const std::map<int, std::vector<PartTypeOrderInfo>>& finalSorted,
+    const std::vector<std::pair<int, Machine>>& sortedMachines)
+{
+    double scanRate = 0.0;
+    for (const auto& machinePair : sortedMachines) {
+        if (machinePair.second.ScanTime > 0) {
+            scanRate += 1.0 / machinePair.second.ScanTime;
+        }
+    }
 
-            std::ofstream outFile(outputFileName);
+    std::vector<LowerBoundItem> parts;
+    for (const auto& entry : finalSorted) {
+        for (const auto& part : entry.second) {
+            double minimumTime = std::numeric_limits<double>::max();
+            for (const auto& machinePair : sortedMachines) {
+                const Machine& machine = machinePair.second;
+                minimumTime = std::min(minimumTime, part.partType->Volume * machine.ScanTime + part.partType->Height * machine.RecoatTime);
+            }
+            if (sortedMachines.empty()) {
+                minimumTime = 0.0;
+            }
+            double weight = part.orderInfo.PenaltyCost;
+            double bound = weight * std::max(0.0, minimumTime - part.orderInfo.DueDate);
+            double work = scanRate > 0 ? part.partType->Volume / scanRate : 0.0;
+            parts.push_back({ weight, part.orderInfo.DueDate, work, bound });
+        }
+    }
+    return wsptSubsetBound(parts);
+}
 
-            read_json(fullPath, outFile, allTestFile); // 傳遞 allTestFile 給 read_json
+// 已解析的實例。PartTypeOrderInfo 與 OrderDetail 內的指標指向 partTypes，因此不可複製
+struct Instance
+{
+    std::string FilePath;
+    std::string Name;
+    std::vector<std::pair<int, Machine>> sortedMachines;
+    std::map<int, PartType> partTypes;
+    std::map<int, Order> orders;
+    std::map<int, std::vector<PartTypeOrderInfo>> finalSorted;
+    std::string warmStartPath;     // 熱啟動排程檔路徑，空字串表示冷啟動
+    std::string warmStartSchedule; // 熱啟動排程檔內容
+    double lowerBound = 0.0;       // computeLowerBound 的結果
+
+    Instance() = default;
+    Instance(const Instance&) = delete;
+    Instance& operator=(const Instance&) = delete;
+};
 
-            outFile.close();
+// 載入階段：解析 JSON 並完成零件排序，不做任何求解
+std::unique_ptr<Instance> loadInstance(const std::string& file_path, const SolveOptions& options)
+{
+    TraceSpan span("load", file_path);
+    auto instance = std::make_unique<Instance>();
+    instance->FilePath = file_path;
+    instance->Name = file_path.substr(file_path.find_last_of("/\\") + 1);
 
-        } while (FindNextFileA(hFind, &findFileData) != 0);
-        FindClose(hFind);
+    std::ifstream file(file_path);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + file_path);
     }
+    json j;
+    file >> j;
 
-    allTestFile.close(); // 關閉全局結果文件
+    // 解析 Machines 部分
+    std::map<int, Machine> machines;
+    for (auto& kv : j["Machines"].items())
+    {
+        int key = std::stoi(kv.key());
+        json value = kv.value();
+        Machine m;
+        m.MachineId = value["MachineId"];
+        m.Area = value["Area"];
+        m.Height = value["Height"];
+        m.Length = value["Length"];
+        m.Width = value["Width"];
+        for (auto& material : value["Materials"])
+        {
+            m.Materials.push_back(material);
+        }
+        for (auto& setup : value["MaterialSetup"])
+        {
+            m.MaterialSetup.push_back(setup.get<std::vector<double>>());
+        }
+        // Parsing the StartSetup as a vector of doubles
+        m.StartSetup = value["StartSetup"].get<std::vector<double>>();
+        // Parsing the ScanTime, RecoatTime, and RemovalTime
+        m.ScanTime = value["ScanTime"];
+        m.RecoatTime = value["RecoatTime"];
+        m.RemovalTime = value["RemovalTime"];
+        machines[key] = m;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    instance->sortedMachines = sortMachines(machines); // 排序好的機器
+
+    // 解析 PartTypes 部分
+    auto& partTypes = instance->partTypes;
+    for (auto& kv : j["PartTypes"].items())
+    {
+        int key = std::stoi(kv.key());
+        json value = kv.value();
+        PartType p;
+        p.PartTypeId = key;
+        p.Height = value["Height"];
+        p.Length = value["Length"];
+        p.Width = value["Width"];
+        p.Area = value["Area"];
+        p.Volume = value["Volume"];
+        partTypes[key] = p;
+    }
+    // 解析 Orders 部分
+    auto& orders = instance->orders;
+    std::map<int, std::vector<OrderDetail>> materialClassifiedOrderDetails;
+    for (auto& kv : j["Orders"].items())
+    {
+        [[maybe_unused]] int key = std::stoi(kv.key());
+        json value = kv.value();
+        Order o;
+        o.OrderId = value["OrderId"];
+        o.DueDate = value["DueDate"];
+        o.ReleaseDate = value["ReleaseDate"];
+        o.PenaltyCost = value["PenaltyCost"];
+        for (auto& detailValue : value["OrderList"])
+        {
+            OrderDetail od;
+            int partTypeId = detailValue["PartType"];
+            od.partType = &partTypes[partTypeId]; // Reference to PartType structure
+            od.Quantity = detailValue["Quantity"];
+            od.Material = detailValue["Material"];
+            od.Quality = detailValue["Quality"];
+            od.OrderId = o.OrderId; // 设置 OrderId
+            materialClassifiedOrderDetails[od.Material].push_back(od);
+            o.OrderList.push_back(od);
+        }
+        orders[o.OrderId] = o;
+    }
+
+    auto sortedMaterials = sortMaterialClassifiedOrderDetails(materialClassifiedOrderDetails, orders, partTypes);
+    instance->finalSorted = generateFinalSortedPartTypes(sortedMaterials, orders, partTypes);
+    instance->lowerBound = computeLowerBound(instance->finalSorted, instance->sortedMachines);
+
+    if (!options.warmStartDir.empty()) {
+        std::string schedulePath = scheduleFilePath(options.warmStartDir, instance->Name);
+        std::ifstream scheduleFile(schedulePath);
+        if (scheduleFile) {
+            std::ostringstream content;
+            content << scheduleFile.rdbuf();
+            instance->warmStartPath = schedulePath;
+            instance->warmStartSchedule = content.str();
+        }
+    }
+
+    return instance;
+}
+
+struct SolveResult
+{
+    std::unique_ptr<Instance> instance;
+    std::vector<MachineBatch> initialMachineBatches;
+    std::vector<MachineBatch> bestMachineBatches;
+    bool warmStarted = false;
+    std::string log; // 搜尋過程的逐步紀錄，由輸出階段寫入報告
+    SolveStats stats;
+};
+
+// 求解階段：只在記憶體中運算，不碰磁碟
+// 由初始解上抽樣 samples 次第四步的變差幅度校準模擬退火起始溫度，
+// 使平均變差的接受機率為 50%；抽樣不到變差時取目標值的 1%
+double calibrateTemperature(const std::vector<MachineBatch>& start, double startObjective,
+    const std::vector<std::pair<int, Machine>>& sortedMachines, const AdaptiveMethodSelector& selector, CounterRng& rng, int samples = 20)
+{
+    double worseningSum = 0.0;
+    int worseningCount = 0;
+    for (int sample = 0; sample < samples; sample++) {
+        std::vector<MachineBatch> candidate = start;
+        StepOutcome outcome = step4(candidate, sortedMachines, selector, rng);
+        if (outcome.Applied && outcome.Result > startObjective) {
+            worseningSum += outcome.Result - startObjective;
+            worseningCount++;
+        }
+    }
+    if (worseningCount == 0) {
+        return 0.01 * startObjective;
+    }
+    return (worseningSum / worseningCount) / std::log(2.0);
+}
+
+// 禁忌搜尋的移動：整批交換、零件搬移到另一批次、整批併入另一批次
+enum class TabuMoveType
+{
+    Swap,
+    Relocate,
+    Merge
+};
+
+struct TabuMove
+{
+    TabuMoveType Type = TabuMoveType::Swap;
+    int MachineA = -1; // 來源機台索引 (排程中的位置)
+    int BatchA = -1;
+    int Part = -1;     // Relocate 搬移的零件在來源批次中的索引
+    int MachineB = -1; // 目標機台索引
+    int BatchB = -1;
+    double Objective = 0.0; // 套用後的總加權延遲
+    std::uint64_t Hash = 0; // 套用後的排程雜湊
+};
+
+// 禁忌搜尋的鄰域。評估移動時只重算受影響的一或兩台機台 (不複製排程)，其餘機台沿用 TotalWeightedDelay，
+// 成本與這兩台機台上的零件數成正比。禁忌屬性為「零件 (零件類型, 訂單) 在 T 次迭代內不得回到原機台」，
+// 同機台內的交換則是「不得回到原機台的原批次位置」
+class TabuNeighbourhood
+{
+public:
+    TabuNeighbourhood(std::vector<MachineBatch>& schedule, const std::vector<std::pair<int, Machine>>& sortedMachines)
+        : schedule(schedule), sortedMachines(sortedMachines)
+    {
+        // 目標值與 updateMachineBatches 相同；solveInstance 已先統一重算過，這裡重算只為了取得一致的快取值
+        for (auto& machineBatch : schedule) {
+            updateMachineBatches(machineBatch, sortedMachines);
+            machines.push_back(&findMachineById(sortedMachines, machineBatch.MachineId));
+        }
+        total = sumTotalWeightedDelay(schedule);
+        hash = scheduleHash(schedule);
+    }
+
+    double objective() const { return total; }
+    std::uint64_t scheduleKey() const { return hash; }
+
+    // 隨機抽一個可行的移動並評估，連續 16 次抽到不可行的移動就放棄。
+    // 先以增量方式算出移動後的雜湊查置換表，命中時沿用保存的目標值，否則重算受影響的機台並存入表中
+    bool sample(CounterRng& rng, TabuMove& move, TranspositionTable& transpositions) const
+    {
+        for (int attempt = 0; attempt < 16; attempt++) {
+            move = TabuMove();
+            move.Type = static_cast<TabuMoveType>(rng.index(3));
+            move.MachineA = static_cast<int>(rng.index(schedule.size()));
+            move.MachineB = static_cast<int>(rng.index(schedule.size()));
+            const auto& batchesA = schedule[move.MachineA].Batches;
+            const auto& batchesB = schedule[move.MachineB].Batches;
+            if (batchesA.empty() || batchesB.empty()) {
+                continue;
+            }
+            move.BatchA = static_cast<int>(rng.index(batchesA.size()));
+            move.BatchB = static_cast<int>(rng.index(batchesB.size()));
+            if (move.MachineA == move.MachineB && move.BatchA == move.BatchB) {
+                continue;
+            }
+            const Batch& a = batchesA[move.BatchA];
+            const Batch& b = batchesB[move.BatchB];
+            double areaA = machines[move.MachineA]->Area;
+            double areaB = machines[move.MachineB]->Area;
+            bool feasible = false;
+            switch (move.Type) {
+            case TabuMoveType::Swap:
+                feasible = a.totalArea <= areaB && b.totalArea <= areaA;
+                break;
+            case TabuMoveType::Relocate:
+                if (!a.parts.empty()) {
+                    move.Part = static_cast<int>(rng.index(a.parts.size()));
+                    const PartTypeOrderInfo& part = a.parts[move.Part];
+                    feasible = part.Material == b.materialType && b.totalArea + part.partType->Area <= areaB;
+                }
+                break;
+            case TabuMoveType::Merge:
+                feasible = a.materialType == b.materialType && a.totalArea + b.totalArea <= areaB;
+                break;
+            }
+            if (!feasible) {
+                continue;
+            }
+            move.Hash = projectedHash(move);
+            if (transpositions.lookup(move.Hash, move.Objective)) {
+                return true;
+            }
+            move.Objective = total - schedule[move.MachineA].TotalWeightedDelay + projectedDelay(move.MachineA, move);
+            if (move.MachineB != move.MachineA) {
+                move.Objective += projectedDelay(move.MachineB, move) - schedule[move.MachineB].TotalWeightedDelay;
+            }
+            transpositions.store(move.Hash, move.Objective);
+            return true;
+        }
+        return false;
+    }
+
+    bool isTabu(const TabuMove& move, long long iteration) const
+    {
+        bool tabu = false;
+        bool sameMachine = move.MachineA == move.MachineB;
+        forEachMovedPart(move, [&](const PartTypeOrderInfo& part, int fromMachine, int fromPosition, int toMachine, int toPosition) {
+            (void)fromMachine;
+            (void)fromPosition;
+            auto it = tabuUntil.find(attribute(part, toMachine, sameMachine ? toPosition : -1));
+            tabu = tabu || (it != tabuUntil.end() && it->second > iteration);
+            });
+        return tabu;
+    }
+
+    void apply(const TabuMove& move, long long iteration, long long tenure)
+    {
+        // 先記下被移走的屬性：零件不得回到來源機台 (同機台交換時為來源位置)
+        bool sameMachine = move.MachineA == move.MachineB;
+        forEachMovedPart(move, [&](const PartTypeOrderInfo& part, int fromMachine, int fromPosition, int toMachine, int toPosition) {
+            (void)toMachine;
+            (void)toPosition;
+            tabuUntil[attribute(part, fromMachine, sameMachine ? fromPosition : -1)] = iteration + tenure;
+            });
+
+        auto& batchesA = schedule[move.MachineA].Batches;
+        auto& batchesB = schedule[move.MachineB].Batches;
+        switch (move.Type) {
+        case TabuMoveType::Swap:
+            std::swap(batchesA[move.BatchA], batchesB[move.BatchB]);
+            break;
+        case TabuMoveType::Relocate: {
+            auto& sourceParts = batchesA[move.BatchA].parts;
+            batchesB[move.BatchB].parts.push_back(sourceParts[move.Part]);
+            sourceParts.erase(sourceParts.begin() + move.Part);
+            if (sourceParts.empty()) {
+                batchesA.erase(batchesA.begin() + move.BatchA);
+            }
+            break;
+        }
+        case TabuMoveType::Merge: {
+            auto& sourceParts = batchesA[move.BatchA].parts;
+            auto& targetParts = batchesB[move.BatchB].parts;
+            targetParts.insert(targetParts.end(), sourceParts.begin(), sourceParts.end());
+            batchesA.erase(batchesA.begin() + move.BatchA);
+            break;
+        }
+        }
+
+        updateMachineBatches(schedule[move.MachineA], sortedMachines);
+        if (move.MachineB != move.MachineA) {
+            updateMachineBatches(schedule[move.MachineB], sortedMachines);
+        }
+        total = sumTotalWeightedDelay(schedule);
+        hash = scheduleHash(schedule);
+    }
+
+private:
+    // 套用 move 之後的排程雜湊。批次雜湊是零件項的和，只加減移動的零件；
+    // 來源批次被刪除時 (合併或搬走最後一個零件) 同機台後面的批次位置前移，這些批次整個重算
+    std::uint64_t projectedHash(const TabuMove& move) const
+    {
+        const auto& batchesA = schedule[move.MachineA].Batches;
+        const Batch& a = batchesA[move.BatchA];
+        const Batch& b = schedule[move.MachineB].Batches[move.BatchB];
+        int idA = schedule[move.MachineA].MachineId;
+        int idB = schedule[move.MachineB].MachineId;
+        std::uint64_t projected = hash;
+        if (move.Type == TabuMoveType::Swap) {
+            projected += batchHash(idA, move.BatchA, b) + batchHash(idB, move.BatchB, a)
+                - batchHash(idA, move.BatchA, a) - batchHash(idB, move.BatchB, b);
+            return projected;
+        }
+        bool erased = move.Type == TabuMoveType::Merge || a.parts.size() == 1;
+        int target = move.BatchB;
+        if (erased) {
+            projected -= batchHash(idA, move.BatchA, a);
+            for (size_t j = move.BatchA + 1; j < batchesA.size(); j++) {
+                projected += batchHash(idA, j - 1, batchesA[j]) - batchHash(idA, j, batchesA[j]);
+            }
+            target -= move.MachineA == move.MachineB && move.BatchB > move.BatchA ? 1 : 0;
+        }
+        std::uint64_t slot = batchSlot(idB, target);
+        if (move.Type == TabuMoveType::Merge) {
+            for (const auto& part : a.parts) {
+                projected += partHash(slot, part);
+            }
+        }
+        else {
+            const PartTypeOrderInfo& part = a.parts[move.Part];
+            projected += partHash(slot, part);
+            if (!erased) {
+                projected -= partHash(batchSlot(idA, move.BatchA), part);
+            }
+        }
+        return projected;
+    }
+
+    // 第 machineIndex 台機台套用 move 之後的總加權延遲
+    double projectedDelay(int machineIndex, const TabuMove& move) const
+    {
+        const Machine& machine = *machines[machineIndex];
+        const auto& batches = schedule[machineIndex].Batches;
+        const Batch& batchA = schedule[move.MachineA].Batches[move.BatchA];
+        const Batch& batchB = schedule[move.MachineB].Batches[move.BatchB];
+        double completion = 0.0;
+        double delay = 0.0;
+        int lastMaterial = -1;
+        for (int i = 0; i < static_cast<int>(batches.size()); i++) {
+            bool atA = machineIndex == move.MachineA && i == move.BatchA;
+            bool atB = machineIndex == move.MachineB && i == move.BatchB;
+            const Batch* base = &batches[i];
+            int skipPart = -1;
+            const Batch* extraBatch = nullptr;
+            const PartTypeOrderInfo* extraPart = nullptr;
+            switch (move.Type) {
+            case TabuMoveType::Swap:
+                base = atA ? &batchB : (atB ? &batchA : base);
+                break;
+            case TabuMoveType::Relocate:
+                if (atA && base->parts.size() == 1) {
+                    continue; // 搬走最後一個零件後批次會被刪除，不再有換料時間
+                }
+                skipPart = atA ? move.Part : -1;
+                extraPart = atB ? &batchA.parts[move.Part] : nullptr;
+                break;
+            case TabuMoveType::Merge:
+                if (atA) {
+                    continue;
+                }
+                extraBatch = atB ? &batchA : nullptr;
+                break;
+            }
+
+            double volume = 0.0;
+            double maxHeight = 0.0;
+            auto forEachPart = [&](auto&& visit) {
+                for (int p = 0; p < static_cast<int>(base->parts.size()); p++) {
+                    if (p != skipPart) {
+                        visit(base->parts[p]);
+                    }
+                }
+                if (extraBatch) {
+                    for (const auto& part : extraBatch->parts) {
+                        visit(part);
+                    }
+                }
+                if (extraPart) {
+                    visit(*extraPart);
+                }
+            };
+            forEachPart([&](const PartTypeOrderInfo& part) {
+                volume += part.partType->Volume;
+                maxHeight = std::max(maxHeight, part.partType->Height);
+                });
+            // 移動只搬同材料的零件，批次材料取 base；合併刪掉的批次已跳過，換料時間依新的相鄰關係計算
+            completion += setupTime(machine, lastMaterial, base->materialType);
+            lastMaterial = base->materialType;
+            completion += volume * machine.ScanTime + maxHeight * machine.RecoatTime;
+            forEachPart([&](const PartTypeOrderInfo& part) {
+                if (completion > part.orderInfo.DueDate) {
+                    delay += (completion - part.orderInfo.DueDate) * part.orderInfo.PenaltyCost;
+                }
+                });
+        }
+        return delay;
+    }
+
+    // 走訪 move 會移動的零件，附上來源與目標的 (機台索引, 批次位置)；交換時 B 的零件反向移動
+    template <typename Visit>
+    void forEachMovedPart(const TabuMove& move, Visit&& visit) const
+    {
+        const Batch& batchA = schedule[move.MachineA].Batches[move.BatchA];
+        if (move.Type == TabuMoveType::Relocate) {
+            visit(batchA.parts[move.Part], move.MachineA, move.BatchA, move.MachineB, move.BatchB);
+            return;
+        }
+        for (const auto& part : batchA.parts) {
+            visit(part, move.MachineA, move.BatchA, move.MachineB, move.BatchB);
+        }
+        if (move.Type == TabuMoveType::Swap) {
+            for (const auto& part : schedule[move.MachineB].Batches[move.BatchB].parts) {
+                visit(part, move.MachineB, move.BatchB, move.MachineA, move.BatchA);
+            }
+        }
+    }
+
+    std::uint64_t attribute(const PartTypeOrderInfo& part, int machineIndex, int position) const
+    {
+        std::uint64_t partKey = static_cast<std::uint64_t>(static_cast<std::uint32_t>(part.partType->PartTypeId)) << 32
+            | static_cast<std::uint32_t>(part.orderInfo.OrderId);
+        std::uint64_t slot = static_cast<std::uint64_t>(static_cast<std::uint32_t>(schedule[machineIndex].MachineId)) << 32
+            | static_cast<std::uint32_t>(position + 1);
+        return mix64(mix64(partKey + zobristKey) ^ slot);
+    }
+
+    std::vector<MachineBatch>& schedule;
+    const std::vector<std::pair<int, Machine>>& sortedMachines;
+    std::vector<const Machine*> machines;
+    std::unordered_map<std::uint64_t, long long> tabuUntil; // 屬性 → 禁忌到第幾次迭代 (不含)
+    double total = 0.0;
+    std::uint64_t hash = 0;
+};
+
+// 精確求解：深度優先分支定界 (目標值與 updateMachineBatches 相同，含換料設定時間)。
+// 每個節點延伸完工時間最早且尚未關閉的機台：下一個批次是同材料、面積不超過機台的零件組合，或關閉該機台。
+// 批次的時間包含依該機台上一批材料計算的 setupTime；下界不含換料時間，仍然是合法的下界。
+// 相同零件 (零件類型, 訂單) 合併成一組，以數量分支，不會產生只差在相同零件互換的節點；
+// 參數相同的機台要求前一台先開、且第一批次的鍵值不大於後一台。節點下界為已排定的延遲加上剩餘零件的
+// wsptSubsetBound (合併機台從最早的完工時間開始，單一零件從各機台目前的完工時間開始)。
+// 剩餘零件與機台狀態 (含最後一批材料) 相同、各機台完工時間都不晚且已排定延遲不高於先前節點的節點直接剪掉 (支配)。
+// 根節點的子節點依下界排序後由多個執行緒分工，共用目前最佳解與節點計數，支配表各執行緒獨立
+class ExactSolver
+{
+public:
+    struct Result
+    {
+        bool Optimal = false;
+        double Objective = 0.0;
+        double LowerBound = 0.0;
+        long long Nodes = 0;
+        bool Improved = false;             // 是否找到比起始上界更好的排程
+        std::vector<MachineBatch> Schedule;
+    };
+
+    ExactSolver(const std::map<int, std::vector<PartTypeOrderInfo>>& finalSorted, const std::vector<std::pair<int, Machine>>& sortedMachines)
+        : sortedMachines(sortedMachines)
+    {
+        for (const auto& entry : finalSorted) {
+            for (const auto& part : entry.second) {
+                auto it = std::find_if(groups.begin(), groups.end(), [&](const Group& group) {
+                    return group.Part.partType == part.partType && group.Part.orderInfo.OrderId == part.orderInfo.OrderId
+                        && group.Part.Material == part.Material;
+                    });
+                if (it != groups.end()) {
+                    it->Count++;
+                }
+                else {
+                    groups.push_back({ part, 1 });
+                }
+            }
+        }
+        // 同材料的組相鄰，交期早的在前，枚舉批次時較早找到好的上界
+        std::stable_sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) {
+            if (a.Part.Material != b.Part.Material) {
+                return a.Part.Material < b.Part.Material;
+            }
+            return a.Part.orderInfo.DueDate < b.Part.orderInfo.DueDate;
+            });
+        for (const auto& machinePair : sortedMachines) {
+            machines.push_back(&machinePair.second);
+        }
+        for (size_t k = 0; k < machines.size(); k++) {
+            int previous = -1;
+            for (size_t j = 0; j < k; j++) {
+                if (machines[j]->ScanTime == machines[k]->ScanTime && machines[j]->RecoatTime == machines[k]->RecoatTime
+                    && machines[j]->Area == machines[k]->Area && machines[j]->StartSetup == machines[k]->StartSetup
+                    && machines[j]->MaterialSetup == machines[k]->MaterialSetup) {
+                    previous = static_cast<int>(j);
+                }
+            }
+            identicalPredecessor.push_back(previous);
+        }
+        hasIdenticalSuccessor.assign(machines.size(), 0);
+        for (int previous : identicalPredecessor) {
+            if (previous >= 0) {
+                hasIdenticalSuccessor[previous] = 1;
+            }
+        }
+    }
+
+    // upperBound 為起始排程 (通常是建構解) 的目標值；deadline 之後或節點數超過 nodeLimit 就停止
+    Result solve(double upperBound, int threadCount, long long nodeLimit, std::chrono::steady_clock::time_point deadline, bool hasDeadline)
+    {
+        incumbent = upperBound;
+        this->nodeLimit = nodeLimit;
+        this->deadline = deadline;
+        this->hasDeadline = hasDeadline;
+
+        Search root(*this);
+        root.Nodes = 1;
+        double rootBound = root.remainingBound();
+        std::vector<Child> children;
+        root.expand(children);
+        nodes = 1;
+
+        std::atomic<size_t> next{ 0 };
+        std::mutex boundMutex;
+        double openBound = std::numeric_limits<double>::infinity();
+        auto worker = [&]() {
+            Search search(*this);
+            double localOpen = std::numeric_limits<double>::infinity();
+            for (size_t index = next++; index < children.size(); index = next++) {
+                search.OpenBound = std::numeric_limits<double>::infinity();
+                search.descend(children[index]);
+                localOpen = std::min(localOpen, search.OpenBound);
+            }
+            search.flushNodes();
+            std::lock_guard<std::mutex> lock(boundMutex);
+            openBound = std::min(openBound, localOpen);
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < threadCount; t++) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        Result result;
+        result.Nodes = nodes.load();
+        result.Objective = incumbent.load();
+        result.Optimal = !aborted.load();
+        result.LowerBound = result.Optimal ? result.Objective : std::min(result.Objective, std::max(rootBound, openBound));
+        result.Improved = !bestBatches.empty();
+        if (result.Improved) {
+            for (size_t k = 0; k < machines.size(); k++) {
+                MachineBatch machineBatch{ machines[k]->MachineId, machines[k]->Area, 0.0, 0.0 };
+                for (const auto& counts : bestBatches[k]) {
+                    Batch batch;
+                    batch.batchId = static_cast<int>(machineBatch.Batches.size());
+                    batch.totalArea = 0.0;
+                    for (size_t g = 0; g < groups.size(); g++) {
+                        for (int c = 0; c < counts[g]; c++) {
+                            batch.parts.push_back(groups[g].Part);
+                            batch.materialType = groups[g].Part.Material;
+                        }
+                    }
+                    machineBatch.Batches.push_back(batch);
+                }
+                updateMachineBatches(machineBatch, sortedMachines);
+                result.Schedule.push_back(machineBatch);
+            }
+        }
+        return result;
+    }
+
+private:
+    struct Group
+    {
+        PartTypeOrderInfo Part;
+        int Count;
+    };
+
+    struct Child
+    {
+        int Machine = -1;          // 延伸的機台；Close 為真時是被關閉的機台
+        bool Close = false;
+        std::vector<int> Counts;   // 批次中每組的數量
+        int Material = -1;
+        int PreviousMaterial = -1; // 延伸前這台機台最後一批的材料，回溯時還原
+        double Time = 0.0;         // 換料設定時間加上加工時間
+        double Cost = 0.0;         // 這個批次的加權延遲
+        double Bound = 0.0;
+    };
+
+    // 單一執行緒的深度優先搜尋狀態，延伸與回溯都在原地修改
+    struct Search
+    {
+        explicit Search(ExactSolver& solver)
+            : solver(solver), remaining(solver.groups.size()), completion(solver.machines.size(), 0.0),
+            closed(solver.machines.size(), 0), lastMaterial(solver.machines.size(), -1), firstKey(solver.machines.size(), 0),
+            batches(solver.machines.size())
+        {
+            for (size_t g = 0; g < solver.groups.size(); g++) {
+                remaining[g] = solver.groups[g].Count;
+                remainingParts += remaining[g];
+            }
+        }
+
+        ExactSolver& solver;
+        std::vector<int> remaining;
+        int remainingParts = 0;
+        std::vector<double> completion;
+        std::vector<char> closed;
+        std::vector<int> lastMaterial;
+        std::vector<std::uint64_t> firstKey;
+        std::vector<std::vector<std::vector<int>>> batches;
+        double cost = 0.0;
+        long long Nodes = 0;
+        double OpenBound = std::numeric_limits<double>::infinity(); // 因節點上限而未展開的節點下界最小值
+        std::vector<LowerBoundItem> items;
+
+        // 支配表：鍵為剩餘數量、關閉旗標與對稱性狀態，值為已展開節點的 (各機台完工時間, 已排定延遲)
+        struct Visited
+        {
+            std::vector<double> Completion;
+            double Cost;
+        };
+        std::unordered_map<std::string, std::vector<Visited>> visited;
+        size_t visitedEntries = 0;
+        static constexpr size_t MaxVisitedEntries = 1 << 20;
+        static constexpr size_t MaxVisitedPerKey = 64;
+
+        // 目前狀態被先前的節點支配時回傳 true，否則把目前狀態記入支配表
+        bool dominated()
+        {
+            std::string key;
+            key.reserve(remaining.size() * sizeof(int) + completion.size() * 14);
+            // 數量以完整寬度寫入，同一組超過 255 個零件時也不會互相撞鍵
+            for (const int& count : remaining) {
+                key.append(reinterpret_cast<const char*>(&count), sizeof(count));
+            }
+            for (size_t k = 0; k < completion.size(); k++) {
+                key.push_back(static_cast<char>(closed[k] | (batches[k].empty() ? 2 : 0)));
+                key.append(reinterpret_cast<const char*>(&lastMaterial[k]), sizeof(lastMaterial[k]));
+                if (solver.hasIdenticalSuccessor[k]) {
+                    key.append(reinterpret_cast<const char*>(&firstKey[k]), sizeof(firstKey[k]));
+                }
+            }
+            // 用 find 查表：上限已滿時不再新增鍵值，記憶體不會隨節點數成長
+            auto it = visited.find(key);
+            if (it != visited.end()) {
+                auto& entries = it->second;
+                for (const Visited& entry : entries) {
+                    bool dominates = entry.Cost <= cost + 1e-9;
+                    for (size_t k = 0; dominates && k < completion.size(); k++) {
+                        dominates = entry.Completion[k] <= completion[k] + 1e-9;
+                    }
+                    if (dominates) {
+                        return true;
+                    }
+                }
+                // 被目前狀態支配的舊紀錄移除
+                size_t kept = 0;
+                for (size_t i = 0; i < entries.size(); i++) {
+                    bool worse = cost <= entries[i].Cost + 1e-9;
+                    for (size_t k = 0; worse && k < completion.size(); k++) {
+                        worse = completion[k] <= entries[i].Completion[k] + 1e-9;
+                    }
+                    if (!worse) {
+                        if (kept != i) {
+                            entries[kept] = std::move(entries[i]);
+                        }
+                        kept++;
+                    }
+                }
+                visitedEntries -= entries.size() - kept;
+                entries.resize(kept);
+            }
+            if (visitedEntries >= MaxVisitedEntries) {
+                if (it != visited.end() && it->second.empty()) {
+                    visited.erase(it);
+                }
+                return false;
+            }
+            if (it == visited.end()) {
+                it = visited.emplace(std::move(key), std::vector<Visited>()).first;
+            }
+            auto& entries = it->second;
+            if (entries.size() >= MaxVisitedPerKey) {
+                entries.erase(entries.begin());
+                visitedEntries--;
+            }
+            entries.push_back({ completion, cost });
+            visitedEntries++;
+            return false;
+        }
+
+        // 剩餘零件的延遲下界 (不含已排定的延遲)。單一零件下界已達 cutoff 時不再計算子集合鬆弛
+        double remainingBound(double cutoff = std::numeric_limits<double>::infinity())
+        {
+            double rate = 0.0;
+            double start = std::numeric_limits<double>::infinity();
+            for (size_t k = 0; k < solver.machines.size(); k++) {
+                if (!closed[k]) {
+                    rate += solver.machines[k]->ScanTime > 0 ? 1.0 / solver.machines[k]->ScanTime : 0.0;
+                    start = std::min(start, completion[k]);
+                }
+            }
+            if (remainingParts == 0) {
+                return 0.0;
+            }
+            if (!std::isfinite(start)) {
+                return std::numeric_limits<double>::infinity(); // 所有機台都關閉了卻還有零件
+            }
+            items.clear();
+            double singleTotal = 0.0;
+            for (size_t g = 0; g < solver.groups.size(); g++) {
+                if (remaining[g] == 0) {
+                    continue;
+                }
+                const PartTypeOrderInfo& part = solver.groups[g].Part;
+                double earliest = std::numeric_limits<double>::infinity();
+                for (size_t k = 0; k < solver.machines.size(); k++) {
+                    if (!closed[k] && part.partType->Area <= solver.machines[k]->Area) {
+                        earliest = std::min(earliest, completion[k] + part.partType->Volume * solver.machines[k]->ScanTime
+                            + part.partType->Height * solver.machines[k]->RecoatTime);
+                    }
+                }
+                if (!std::isfinite(earliest)) {
+                    return std::numeric_limits<double>::infinity(); // 沒有開著的機台放得下這個零件
+                }
+                double weight = part.orderInfo.PenaltyCost;
+                double single = weight * std::max(0.0, earliest - part.orderInfo.DueDate);
+                double work = rate > 0 ? part.partType->Volume / rate : 0.0;
+                for (int c = 0; c < remaining[g]; c++) {
+                    items.push_back({ weight, part.orderInfo.DueDate - start, work, single });
+                }
+                singleTotal += remaining[g] * single;
+            }
+            if (singleTotal >= cutoff) {
+                return singleTotal;
+            }
+            return wsptSubsetBound(items);
+        }
+
+        // 產生目前節點的所有子節點並依下界排序
+        void expand(std::vector<Child>& children)
+        {
+            children.clear();
+            int machine = -1;
+            for (size_t k = 0; k < solver.machines.size(); k++) {
+                if (!closed[k] && (machine < 0 || completion[k] < completion[machine])) {
+                    machine = static_cast<int>(k);
+                }
+            }
+            if (machine < 0 || remainingParts == 0) {
+                return;
+            }
+            const Machine& target = *solver.machines[machine];
+            int predecessor = solver.identicalPredecessor[machine];
+            bool firstBatch = batches[machine].empty();
+            if (firstBatch && predecessor >= 0 && batches[predecessor].empty()) {
+                // 參數相同的前一台機台沒有開，這台也不開 (兩者互換是同一個排程)
+            }
+            else {
+                std::vector<int> counts(solver.groups.size(), 0);
+                size_t begin = 0;
+                while (begin < solver.groups.size()) {
+                    size_t end = begin;
+                    while (end < solver.groups.size() && solver.groups[end].Part.Material == solver.groups[begin].Part.Material) {
+                        end++;
+                    }
+                    enumerate(children, counts, machine, target, begin, end, begin, 0.0, firstBatch ? predecessor : -1);
+                    begin = end;
+                }
+            }
+            // 關閉這台機台，但至少要留一台開著
+            int openMachines = 0;
+            for (size_t k = 0; k < solver.machines.size(); k++) {
+                openMachines += closed[k] ? 0 : 1;
+            }
+            if (openMachines > 1) {
+                closed[machine] = 1;
+                Child close;
+                close.Machine = machine;
+                close.Close = true;
+                close.Bound = cost + remainingBound();
+                closed[machine] = 0;
+                children.push_back(close);
+            }
+            std::stable_sort(children.begin(), children.end(), [](const Child& a, const Child& b) {
+                return a.Bound < b.Bound;
+                });
+        }
+
+        // 在 [begin, end) 這一段同材料的組中枚舉數量組合
+        void enumerate(std::vector<Child>& children, std::vector<int>& counts, int machine, const Machine& target,
+            size_t begin, size_t end, size_t g, double area, int predecessor)
+        {
+            if (g == end) {
+                bool empty = std::all_of(counts.begin() + begin, counts.begin() + end, [](int c) { return c == 0; });
+                if (empty) {
+                    return;
+                }
+                if (predecessor >= 0 && batchKey(counts) < firstKey[predecessor]) {
+                    return;
+                }
+                Child child;
+                child.Machine = machine;
+                child.Counts = counts;
+                child.Material = solver.groups[begin].Part.Material;
+                child.PreviousMaterial = lastMaterial[machine];
+                double volume = 0.0, maxHeight = 0.0;
+                for (size_t i = begin; i < end; i++) {
+                    if (counts[i] > 0) {
+                        volume += counts[i] * solver.groups[i].Part.partType->Volume;
+                        maxHeight = std::max(maxHeight, solver.groups[i].Part.partType->Height);
+                    }
+                }
+                child.Time = setupTime(target, child.PreviousMaterial, child.Material)
+                    + volume * target.ScanTime + maxHeight * target.RecoatTime;
+                double finish = completion[machine] + child.Time;
+                for (size_t i = begin; i < end; i++) {
+                    const OrderInfo& order = solver.groups[i].Part.orderInfo;
+                    if (counts[i] > 0 && finish > order.DueDate) {
+                        child.Cost += counts[i] * order.PenaltyCost * (finish - order.DueDate);
+                    }
+                }
+                double incumbent = solver.incumbent.load();
+                if (cost + child.Cost >= incumbent - 1e-9) {
+                    return;
+                }
+                apply(child);
+                child.Bound = cost + remainingBound(incumbent - cost);
+                undo(child);
+                if (child.Bound < incumbent - 1e-9) {
+                    children.push_back(std::move(child));
+                }
+                return;
+            }
+            double partArea = solver.groups[g].Part.partType->Area;
+            for (int c = 0; c <= remaining[g] && area + c * partArea <= target.Area; c++) {
+                counts[g] = c;
+                enumerate(children, counts, machine, target, begin, end, g + 1, area + c * partArea, predecessor);
+            }
+            counts[g] = 0;
+        }
+
+        std::uint64_t batchKey(const std::vector<int>& counts) const
+        {
+            std::uint64_t key = 0;
+            for (size_t g = 0; g < counts.size(); g++) {
+                key = key * 31 + static_cast<std::uint64_t>(counts[g]);
+            }
+            return key;
+        }
+
+        void apply(const Child& child)
+        {
+            if (child.Close) {
+                closed[child.Machine] = 1;
+                return;
+            }
+            if (batches[child.Machine].empty()) {
+                firstKey[child.Machine] = batchKey(child.Counts);
+            }
+            batches[child.Machine].push_back(child.Counts);
+            lastMaterial[child.Machine] = child.Material;
+            for (size_t g = 0; g < remaining.size(); g++) {
+                remaining[g] -= child.Counts[g];
+                remainingParts -= child.Counts[g];
+            }
+            completion[child.Machine] += child.Time;
+            cost += child.Cost;
+        }
+
+        void undo(const Child& child)
+        {
+            if (child.Close) {
+                closed[child.Machine] = 0;
+                return;
+            }
+            batches[child.Machine].pop_back();
+            lastMaterial[child.Machine] = child.PreviousMaterial;
+            for (size_t g = 0; g < remaining.size(); g++) {
+                remaining[g] += child.Counts[g];
+                remainingParts += child.Counts[g];
+            }
+            completion[child.Machine] -= child.Time;
+            cost -= child.Cost;
+        }
+
+        void descend(const Child& child)
+        {
+            if (child.Bound >= solver.incumbent.load() - 1e-9) {
+                return;
+            }
+            if (solver.aborted.load() || !countNode()) {
+                OpenBound = std::min(OpenBound, child.Bound);
+                return;
+            }
+            apply(child);
+            if (remainingParts == 0) {
+                solver.offer(cost, batches);
+            }
+            else if (dominated()) {
+                // 先前展開過更好的相同狀態
+            }
+            else {
+                std::vector<Child> children;
+                expand(children);
+                for (const Child& next : children) {
+                    descend(next);
+                }
+            }
+            undo(child);
+        }
+
+        // 每 1024 個節點才更新共用計數並檢查時限
+        bool countNode()
+        {
+            if (++Nodes % 1024 == 0) {
+                flushNodes();
+                if (solver.nodes.load() >= solver.nodeLimit
+                    || (solver.hasDeadline && std::chrono::steady_clock::now() >= solver.deadline)) {
+                    solver.aborted = true;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void flushNodes()
+        {
+            solver.nodes += Nodes - flushed;
+            flushed = Nodes;
+        }
+
+        long long flushed = 0;
+    };
+
+    void offer(double objective, const std::vector<std::vector<std::vector<int>>>& batches)
+    {
+        std::lock_guard<std::mutex> lock(incumbentMutex);
+        if (objective < incumbent.load()) {
+            incumbent = objective;
+            bestBatches = batches;
+        }
+    }
+
+    const std::vector<std::pair<int, Machine>>& sortedMachines;
+    std::vector<Group> groups;
+    std::vector<const Machine*> machines;
+    std::vector<int> identicalPredecessor; // 參數相同的前一台機台索引，沒有則為 -1
+    std::vector<char> hasIdenticalSuccessor;
+    std::atomic<double> incumbent{ 0.0 };
+    std::mutex incumbentMutex;
+    std::vector<std::vector<std::vector<int>>> bestBatches;
+    std::atomic<long long> nodes{ 0 };
+    std::atomic<bool> aborted{ false };
+    long long nodeLimit = 0;
+    std::chrono::steady_clock::time_point deadline;
+    bool hasDeadline = false;
+};
+
+SolveResult solveInstance(std::unique_ptr<Instance> instance, const SolveOptions& options)
+{
+    SolveResult solveResult;
+    const auto& sortedMachines = instance->sortedMachines;
+    const auto& finalSorted = instance->finalSorted;
+    std::ostringstream searchLog;
+
+    SolveStats stats;
+    stats.InstanceName = instance->Name;
+    stats.Family = parseInstanceFamily(stats.InstanceName);
+    stats.LowerBound = instance->lowerBound;
+    CounterRng rng = CounterRng(options.seed).split(CounterRng::streamId(stats.InstanceName));
+    stats.Seed = options.seed;
+    stats.RngStream = rng.streamKey();
+    TraceSpan solveSpan("solve", stats.InstanceName);
+    auto wallStart = std::chrono::steady_clock::now();
+    double cpuStart = threadCpuSeconds();
+
+    // 計數器只量測本執行緒，因此每次求解各自開啟
+    std::unique_ptr<PerfCounters> perf;
+    if (options.perfCounters) {
+        perf = std::make_unique<PerfCounters>();
+        stats.PerfEnabled = perf->available();
+    }
+    PerfSample perfBegin;
+    auto perfStart = [&]() {
+        if (stats.PerfEnabled) {
+            perfBegin = perf->read();
+        }
+    };
+    auto perfStop = [&](PerfPhase phase) {
+        if (stats.PerfEnabled) {
+            stats.Perf[phase].accumulate(perfBegin, perf->read());
+        }
+    };
+
+    std::vector<MachineBatch> machineBatches;
+    std::unique_ptr<TraceSpan> constructionSpan = std::make_unique<TraceSpan>("construction", stats.InstanceName);
+    perfStart();
+    bool warmStarted = false;
+    if (!instance->warmStartSchedule.empty()) {
+        std::istringstream scheduleFile(instance->warmStartSchedule);
+        try {
+            machineBatches = loadSchedule(scheduleFile, finalSorted, sortedMachines);
+            warmStarted = true;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Warm start ignored for " << stats.InstanceName << ": " << e.what() << "\n";
+        }
+    }
+    if (!warmStarted) {
+        machineBatches = createMachineBatches(finalSorted, sortedMachines);
+    }
+    // 建構、插入與暖啟動各自累計完工時間，先統一用 updateMachineBatches 重算一次，
+    // 讓初始解與之後所有引擎都以同一個目標 (含換料設定時間) 比較
+    for (auto& machineBatch : machineBatches) {
+        updateMachineBatches(machineBatch, sortedMachines);
+    }
+    // 建構出的批次順序依到期日貪婪決定，先做一次單機重排
+    stats.ResequencedMachines = resequenceSchedule(machineBatches, sortedMachines, options.resequenceThreshold);
+    perfStop(PerfConstruction);
+    constructionSpan.reset();
+
+    double result = sumTotalWeightedDelay(machineBatches);
+
+    int machineSize = sortedMachines.size();
+    int partSize = calculateTotalSize(finalSorted);
+
+    //如果零件懲罰權重為零，就一定放在最後做 (就是等演算法結束，最後再把它隨便插回去)
+    // auto extractedParts = extractAndRemoveZeroPenaltyParts(machineBatches, sortedMachines);
+
+    auto bestMachineBatches = machineBatches;
+    double bestResult = result; // 這裡使用深拷貝以確保完全獨立
+
+    // 模擬退火的目前解：第四步可能接受較差的解，因此與最佳解分開保存
+    auto currentMachineBatches = machineBatches;
+    double currentObjective = result;
+
+    // 收斂軌跡只記錄目前為止見過的最小值
+    double incumbent = result;
+    auto elapsedSeconds = [&]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    };
+    long long incumbentIteration = 0;
+    auto recordIncumbent = [&]() {
+        if (bestResult < incumbent) {
+            incumbent = bestResult;
+            incumbentIteration = stats.Iterations;
+            stats.Trace.push_back({ elapsedSeconds(), stats.Iterations, incumbent });
+        }
+    };
+
+    // 停滯判斷都以目前為止見過的最小值為準；incumbentWindow 保存最近 rateWindow 次迭代開始時的值
+    bool useRateRule = options.rateWindow > 0 && options.minImprovementRate > 0;
+    std::deque<double> incumbentWindow;
+    auto stagnated = [&]() {
+        if (options.stallIterations > 0 && stats.Iterations - incumbentIteration >= options.stallIterations) {
+            stats.Stop = StopReason::Stalled;
+            return true;
+        }
+        if (useRateRule) {
+            if (static_cast<long long>(incumbentWindow.size()) == options.rateWindow) {
+                double windowStart = incumbentWindow.front();
+                if (windowStart - incumbent < options.minImprovementRate * windowStart) {
+                    stats.Stop = StopReason::LowImprovementRate;
+                    return true;
+                }
+                incumbentWindow.pop_front();
+            }
+            incumbentWindow.push_back(incumbent);
+        }
+        return false;
+    };
+    // 有時限時不限迭代次數，在每一步之前檢查單調時鐘，時間到就回傳目前最佳解
+    bool hasDeadline = options.instanceTimeSeconds > 0;
+    auto deadline = wallStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.instanceTimeSeconds));
+    auto deadlinePassed = [&]() {
+        return hasDeadline && std::chrono::steady_clock::now() >= deadline;
+    };
+    long long iterationLimit = hasDeadline ? std::numeric_limits<long long>::max()
+        : static_cast<long long>(machineSize) * partSize * 45;
+    stats.IterationBudget = hasDeadline ? 0 : iterationLimit;
+    stats.Trace.push_back({ elapsedSeconds(), 0, result });
+    stats.Engine = options.engine;
+
+    // 每次迭代開始前的停止條件，兩種搜尋引擎共用
+    auto shouldStop = [&]() {
+        if (bestResult == 0) {
+            stats.Stop = StopReason::ZeroObjective;
+            return true;
+        }
+        if (bestResult <= stats.LowerBound * (1.0 + 1e-9) + 1e-9) {
+            stats.Stop = StopReason::ReachedLowerBound;
+            return true;
+        }
+        if (deadlinePassed()) {
+            stats.Stop = StopReason::Deadline;
+            return true;
+        }
+        return stagnated();
+    };
+    // 初始解已經是 0 時不會進入任何搜尋迴圈，停止原因在這裡先定好
+    if (result == 0) {
+        stats.Stop = StopReason::ZeroObjective;
+    }
+
+    // 運算子遙測：before 為運算子開始前工作解的總加權延遲
+    auto recordOperator = [&](OperatorId id, const StepOutcome& outcome, double before, const OperatorCost& cost, bool accepted) {
+        OperatorStats& op = stats.Operators[id];
+        double delta = outcome.Result - before;
+        op.Invocations++;
+        op.CpuSeconds += cost.CpuSeconds;
+        op.Allocations += cost.Allocations;
+        op.Bytes += cost.Bytes;
+        op.DeltaSum += delta;
+        if (!outcome.Applied) {
+            op.NoOps++;
+        }
+        if (delta < 0) {
+            op.Improving++;
+        }
+        else if (delta > 0 && accepted) {
+            op.AcceptedWorsening++;
+        }
+    };
+
+    // 置換表記錄訪問過的排程雜湊與目標值；候選解與目前解雜湊相同視為無效移動，第四步不再接受已訪問過且沒有改進的排程。
+    // 禁忌搜尋共用同一張表，在評估移動之前查表
+    TranspositionTable transpositions(options.transpositionEntries);
+    std::uint64_t currentHash = scheduleHash(currentMachineBatches);
+    std::uint64_t bestHash = currentHash;
+    transpositions.store(currentHash, currentObjective);
+    auto examineCandidate = [&](StepOutcome& outcome, std::uint64_t hash) {
+        if (hash == currentHash) {
+            outcome.Applied = false;
+        }
+        double cached = 0.0;
+        bool seen = transpositions.lookup(hash, cached);
+        if (!seen) {
+            transpositions.store(hash, outcome.Result);
+        }
+        return seen;
+    };
+
+    // 接受候選解為目前解，優於最佳解時一併更新最佳解
+    auto acceptCandidate = [&](const std::vector<MachineBatch>& candidate, double objective, std::uint64_t hash) {
+        currentMachineBatches = candidate;
+        currentObjective = objective;
+        currentHash = hash;
+        stats.AcceptedMoves++;
+        if (objective < bestResult) {
+            bestMachineBatches = candidate;
+            bestResult = objective;
+            bestHash = hash;
+            recordIncumbent();
+        }
+    };
+
+    AdaptiveMethodSelector methodSelector;
+
+    // 模擬退火溫度：T0 使平均變差幅度的接受機率為 50%，依搜尋進度 (迭代數或時限) 幾何降溫到 T0 × finalTemperatureRatio。
+    // 最佳解連續 reheatAfter 次迭代沒有改進時，從最佳解重新出發並回溫到 T0 × reheatLevel
+    const double finalTemperatureRatio = 1e-3;
+    const double reheatLevel = 0.5;
+    long long reheatAfter = options.reheatAfter > 0 ? options.reheatAfter
+        : (hasDeadline ? 200 : std::max<long long>(100, iterationLimit / 20));
+    bool annealing = options.engine == SearchEngine::Annealing;
+    double initialTemperature = result > 0 && annealing ? calibrateTemperature(machineBatches, result, sortedMachines, methodSelector, rng) : 0.0;
+    double reheatScale = 1.0;
+    long long lastReheatIteration = 0;
+    auto searchProgress = [&]() {
+        if (hasDeadline) {
+            return std::min(1.0, elapsedSeconds() / options.instanceTimeSeconds);
+        }
+        return static_cast<double>(stats.Iterations) / static_cast<double>(iterationLimit);
+    };
+    auto temperature = [&]() {
+        return initialTemperature * reheatScale * std::pow(finalTemperatureRatio, searchProgress());
+    };
+    stats.InitialTemperature = initialTemperature;
+    std::uniform_real_distribution<double> acceptanceDistribution(0.0, 1.0);
+
+    AllocationCounters searchAllocStart = allocationCounters;
+    if (result != 0 && annealing) {
+
+        auto tempMachineBatches = currentMachineBatches;
+
+        for (long long i = 0;i < iterationLimit;i++) {
+            if (shouldStop()) {
+                break;
+            }
+            if (stats.Iterations - std::max(incumbentIteration, lastReheatIteration) >= reheatAfter) {
+                reheatScale = reheatLevel / std::pow(finalTemperatureRatio, searchProgress());
+                lastReheatIteration = stats.Iterations;
+                stats.Reheats++;
+                currentMachineBatches = bestMachineBatches;
+                currentObjective = bestResult;
+                currentHash = bestHash;
+                searchLog << "回溫至 " << temperature() << "，從最佳解 " << bestResult << " 重新出發\n";
+            }
+
+            stats.Iterations++;
+            tempMachineBatches = currentMachineBatches;
+            double before = currentObjective;
+            double opCpuStart = threadCpuSeconds();
+            AllocationCounters opAllocStart = allocationCounters;
+            perfStart();
+            StepOutcome outcome2 = step2(tempMachineBatches, sortedMachines, rng);
+            perfStop(PerfStep2);
+            double currentResult = outcome2.Result;
+            std::uint64_t hash2 = scheduleHash(tempMachineBatches);
+            examineCandidate(outcome2, hash2);
+            recordOperator(OperatorStep2, outcome2, before, costSince(opCpuStart, opAllocStart), currentResult < currentObjective);
+
+            if (currentResult < currentObjective) {
+                acceptCandidate(tempMachineBatches, currentResult, hash2);
+                searchLog << "第二步改進的解 : " << currentResult << "\n";
+            }
+            else {
+                searchLog << "第二步保留之前的解，當前解：" << currentResult << "\n";
+            }
+
+            if (currentResult == 0 || deadlinePassed()) {
+                continue; // 如果第二步結果為 0 或時間已到，跳過後續步驟
+            }
+
+            // 第三、四步都從目前解出發
+            tempMachineBatches = currentMachineBatches;
+            before = currentObjective;
+            opCpuStart = threadCpuSeconds();
+            opAllocStart = allocationCounters;
+            perfStart();
+            StepOutcome outcome3 = step3(tempMachineBatches, sortedMachines, rng);
+            perfStop(PerfStep3);
+            double currentResult2 = outcome3.Result;
+            std::uint64_t hash3 = scheduleHash(tempMachineBatches);
+            examineCandidate(outcome3, hash3);
+            recordOperator(OperatorStep3, outcome3, before, costSince(opCpuStart, opAllocStart), currentResult2 < currentObjective);
+
+            if (currentResult2 < currentObjective) {
+                acceptCandidate(tempMachineBatches, currentResult2, hash3);
+                searchLog << "第三步改進的解 : " << currentResult2 << "\n";
+            }
+            else {
+                searchLog << "第三步保留之前的解，當前解：" << currentResult2 << "\n";
+            }
+
+            if (currentResult2 == 0 || deadlinePassed()) {
+                continue; // 如果第三步結果為 0 或時間已到，跳過後續步驟
+            }
+
+            tempMachineBatches = currentMachineBatches;
+            before = currentObjective;
+            opCpuStart = threadCpuSeconds();
+            opAllocStart = allocationCounters;
+            perfStart();
+            StepOutcome outcome4 = step4(tempMachineBatches, sortedMachines, methodSelector, rng);
+            perfStop(PerfStep4);
+            OperatorCost step4Cost = costSince(opCpuStart, opAllocStart);
+            double currentResult3 = outcome4.Result;
+            std::uint64_t hash4 = scheduleHash(tempMachineBatches);
+            bool revisit = examineCandidate(outcome4, hash4);
+
+            // Metropolis 準則，與目前解比較；已訪問過的排程除非改進否則不接受，避免來回循環
+            double delta = currentResult3 - currentObjective;
+            double currentTemperature = temperature();
+            bool accepted4 = false;
+            if (outcome4.Applied && delta < 0) {
+                accepted4 = true;
+            }
+            else if (outcome4.Applied && revisit) {
+                stats.RevisitsRejected++;
+            }
+            else if (outcome4.Applied) {
+                accepted4 = delta == 0 ||
+                    (currentTemperature > 0 && acceptanceDistribution(rng) < std::exp(-delta / currentTemperature));
+            }
+            recordOperator(OperatorStep4, outcome4, before, step4Cost, accepted4);
+            if (outcome4.Method >= 1 && outcome4.Method <= 6) {
+                recordOperator(static_cast<OperatorId>(OperatorMethod1 + outcome4.Method - 1), outcome4, before, outcome4.MethodCost, accepted4);
+
+                double methodScore = 0.0;
+                if (outcome4.Applied) {
+                    if (currentResult3 < bestResult) {
+                        methodScore = AdaptiveMethodSelector::ScoreNewBest;
+                    }
+                    else if (delta < 0) {
+                        methodScore = AdaptiveMethodSelector::ScoreImproved;
+                    }
+                    else if (accepted4 && delta > 0) {
+                        methodScore = AdaptiveMethodSelector::ScoreAccepted;
+                    }
+                }
+                methodSelector.reward(outcome4.Method, methodScore);
+            }
+            if (accepted4) {
+                acceptCandidate(tempMachineBatches, currentResult3, hash4);
+                searchLog << "第四步接受的解 : " << currentResult3 << "\n";
+            }
+            else {
+                searchLog << "第四步保留之前的解，當前解：" << currentResult3 << "\n";
+            }
+        }
+    }
+    stats.FinalTemperature = result != 0 && annealing ? temperature() : 0.0;
+
+    // 禁忌搜尋：每次迭代抽樣 tabuSamples 個移動，採用最好的非禁忌移動 (即使變差)；
+    // 禁忌移動只有在優於最佳解時才特赦。禁忌期在 [tenure, 1.5 × tenure] 之間隨機。
+    // 精確求解也先跑禁忌搜尋，以它的最佳解作為分支定界的起始上界；有時限時暖身只用 exactWarmupShare 的時間，其餘留給分支定界
+    const double exactWarmupShare = 0.2;
+    bool warmupOnly = options.engine == SearchEngine::Exact;
+    auto warmupDeadline = wallStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.instanceTimeSeconds * exactWarmupShare));
+    if (result != 0 && (options.engine == SearchEngine::Tabu || warmupOnly)) {
+        TabuNeighbourhood neighbourhood(currentMachineBatches, sortedMachines);
+        currentObjective = neighbourhood.objective();
+        long long tenure = options.tabuTenure > 0 ? options.tabuTenure
+            : std::max<long long>(5, partSize / 10 + machineSize);
+        stats.TabuTenure = tenure;
+
+        for (long long i = 0; i < iterationLimit; i++) {
+            if (shouldStop()) {
+                break;
+            }
+            if (warmupOnly && hasDeadline && std::chrono::steady_clock::now() >= warmupDeadline) {
+                break;
+            }
+            stats.Iterations++;
+            double opCpuStart = threadCpuSeconds();
+            AllocationCounters opAllocStart = allocationCounters;
+
+            TabuMove chosen;
+            bool found = false;
+            bool chosenTabu = false;
+            for (int sample = 0; sample < options.tabuSamples; sample++) {
+                TabuMove move;
+                if (!neighbourhood.sample(rng, move, transpositions)) {
+                    continue;
+                }
+                stats.TabuEvaluations++;
+                bool tabu = neighbourhood.isTabu(move, stats.Iterations);
+                if (tabu && move.Objective >= bestResult) {
+                    stats.TabuRejected++;
+                    continue;
+                }
+                if (!found || move.Objective < chosen.Objective) {
+                    chosen = move;
+                    chosenTabu = tabu;
+                    found = true;
+                }
+            }
+            if (!found) {
+                searchLog << "禁忌搜尋找不到可行的移動\n";
+                continue;
+            }
+
+            double before = currentObjective;
+            neighbourhood.apply(chosen, stats.Iterations, tenure + static_cast<long long>(rng.index(tenure / 2 + 1)));
+            currentObjective = neighbourhood.objective();
+            stats.AcceptedMoves++;
+            if (chosenTabu) {
+                stats.TabuAspirations++;
+            }
+            OperatorId id = chosen.Type == TabuMoveType::Swap ? OperatorTabuSwap
+                : (chosen.Type == TabuMoveType::Relocate ? OperatorTabuRelocate : OperatorTabuMerge);
+            recordOperator(id, { currentObjective, true, 0, OperatorCost() }, before, costSince(opCpuStart, opAllocStart), true);
+
+            if (currentObjective < bestResult) {
+                bestMachineBatches = currentMachineBatches;
+                bestResult = currentObjective;
+                recordIncumbent();
+                searchLog << "禁忌搜尋改進的解 : " << currentObjective << "\n";
+            }
+        }
+    }
+
+    // 分支定界：起始上界為禁忌搜尋的最佳解；證明最佳時下界等於最佳解，否則回報剩餘節點的下界
+    if (result != 0 && options.engine == SearchEngine::Exact) {
+        if (bestResult > 0 && bestResult > stats.LowerBound * (1.0 + 1e-9) + 1e-9 && !deadlinePassed()) {
+            ExactSolver exact(finalSorted, sortedMachines);
+            ExactSolver::Result exactResult = exact.solve(bestResult, options.exactThreads, options.exactNodeLimit, deadline, hasDeadline);
+            stats.Iterations = exactResult.Nodes;
+            stats.ExactNodes = exactResult.Nodes;
+            // 分支定界的目標要與其他引擎相同才能宣稱最佳或回報它的下界：找到的排程以 updateMachineBatches 重算，
+            // 和分支定界自己累加的值不符 (超出浮點誤差) 時只保留排程，不採用證明與下界
+            bool consistent = true;
+            if (exactResult.Improved) {
+                double recomputed = sumTotalWeightedDelay(exactResult.Schedule);
+                consistent = std::abs(recomputed - exactResult.Objective) <= 1e-6 * std::max(1.0, std::abs(recomputed));
+                if (!consistent) {
+                    searchLog << "分支定界的目標值 " << exactResult.Objective << " 與重算值 " << recomputed << " 不符，不採用最佳性證明\n";
+                }
+                if (recomputed < bestResult) {
+                    bestMachineBatches = std::move(exactResult.Schedule);
+                    bestResult = recomputed;
+                    recordIncumbent();
+                }
+            }
+            bool optimal = exactResult.Optimal && consistent;
+            stats.ExactOptimal = optimal;
+            // 分支定界以逐批累加計算延遲，和 sumTotalWeightedDelay 的浮點誤差不同；
+            // 證明最佳時下界直接取最佳解，否則夾在最佳解以下，差距不會是負的
+            if (optimal) {
+                stats.LowerBound = bestResult;
+            }
+            else if (consistent) {
+                stats.LowerBound = std::min(bestResult, std::max(stats.LowerBound, exactResult.LowerBound));
+            }
+            stats.Stop = optimal ? StopReason::ProvenOptimal
+                : (deadlinePassed() ? StopReason::Deadline : StopReason::NodeLimit);
+            searchLog << "分支定界 : " << exactResult.Nodes << " 個節點，" << (exactResult.Optimal ? "已證明最佳" : "未走完")
+                << "，最佳解 " << bestResult << "，下界 " << stats.LowerBound << "\n";
+        }
+    }
+    stats.TranspositionLookups = transpositions.Lookups;
+    stats.TranspositionHits = transpositions.Hits;
+
+    // 搜尋結束後對最佳解再做一次單機重排；改進量以重排前後同一個目標 (updateMachineBatches) 相減，只反映順序的改變
+    if (bestResult > 0) {
+        int changed = resequenceSchedule(bestMachineBatches, sortedMachines, options.resequenceThreshold);
+        if (changed > 0) {
+            double beforeResequence = bestResult;
+            bestResult = sumTotalWeightedDelay(bestMachineBatches);
+            stats.ResequencedMachines += changed;
+            stats.ResequenceGain = beforeResequence - bestResult;
+            recordIncumbent();
+            searchLog << "批次重排 : " << changed << " 台機台，改進 " << stats.ResequenceGain << "\n";
+        }
+    }
+
+    searchLog << "下界 : " << stats.LowerBound << "，最佳解 : " << bestResult << "，差距 : "
+        << (bestResult > 0 ? (bestResult - stats.LowerBound) / bestResult * 100.0 : 0.0) << "%\n";
+
+    // sortAndInsertParts(bestMachineBatches, sortedMachines, extractedParts); 把零件權重 0 的放回去
+    // bestResult = sumTotalWeightedDelay(bestMachineBatches);
+
+    stats.MethodWeights = methodSelector.currentWeights();
+    stats.SearchAllocations = allocationCounters.Allocations - searchAllocStart.Allocations;
+    stats.SearchBytes = allocationCounters.Bytes - searchAllocStart.Bytes;
+    stats.WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    stats.CpuSeconds = threadCpuSeconds() - cpuStart;
+    stats.PeakRssKb = peakRssKb();
+    stats.InitialResult = result;
+    stats.BestResult = bestResult;
+    summarizeConvergence(stats);
+
+    solveResult.instance = std::move(instance);
+    solveResult.initialMachineBatches = std::move(machineBatches);
+    solveResult.bestMachineBatches = std::move(bestMachineBatches);
+    solveResult.warmStarted = warmStarted;
+    solveResult.log = searchLog.str();
+    solveResult.stats = stats;
+    return solveResult;
+}
+
+// 輸出階段：格式化單一實例的完整報告與 allTest 摘要
+void writeReport(const SolveResult& solveResult, std::ostream& outFile, std::ostream& allTestFile)
+{
+    const SolveStats& stats = solveResult.stats;
+    TraceSpan span("report", stats.InstanceName);
+    ReportWriter report(outFile);
+
+    if (solveResult.warmStarted) {
+        report << "  熱啟動自 : " << solveResult.instance->warmStartPath << "\n";
+    }
+    printMachineBatch(solveResult.initialMachineBatches, report);
+
+    report << "----------------------------------" << "\n";
+    report << "  初始解 : " << stats.InitialResult << "\n"; //step 6.
+    report << "----------------------------------" << "\n";
+    report << solveResult.log;
+
+    report << "**********************************" << "\n";
+    printMachineBatch(solveResult.bestMachineBatches, report);
+    report << "結果 : " << "\n";
+    report << "  初始解 : " << stats.InitialResult << "\n";
+    report << "  最佳解 : " << stats.BestResult << "\n";
+    report << "  下界 : " << stats.LowerBound << "\n";
+    report << "  與下界差距 : " << stats.gap() * 100.0 << "%\n";
+    report << "**********************************" << "\n";
+    report << "收斂軌跡 (秒, 迭代, 最佳解) :\n";
+    for (const auto& point : stats.Trace) {
+        report << "  " << point.Seconds << ", " << point.Iteration << ", " << point.Best << "\n";
+    }
+    report << "  達到最終值 1% 以內 : " << stats.TimeToWithin1Percent << " 秒\n";
+    report << "  達到最終值 5% 以內 : " << stats.TimeToWithin5Percent << " 秒\n";
+    report << "  停止原因 : " << stopReasonName(stats.Stop) << "\n";
+    report << "  最後改進 : 第 " << stats.LastImprovementIteration << " / "
+        << (stats.IterationBudget > 0 ? stats.IterationBudget : stats.Iterations)
+        << " 次迭代, " << stats.LastImprovementSeconds << " 秒 (總計 " << stats.WallSeconds << " 秒)\n";
+    report << "**********************************" << "\n";
+    report << "運算子統計 (呼叫, 無變動, 改進, 接受變差, 平均差值, CPU 秒, 配置次數, 配置位元組) :\n";
+    for (int id = 0; id < OperatorCount; id++) {
+        const OperatorStats& op = stats.Operators[id];
+        report << "  " << operatorNames[id] << " : " << op.Invocations << ", " << op.NoOps << ", " << op.Improving
+            << ", " << op.AcceptedWorsening << ", " << op.meanDelta() << ", " << op.CpuSeconds
+            << ", " << static_cast<long long>(op.Allocations) << ", " << static_cast<long long>(op.Bytes) << "\n";
+    }
+    report << "  亂數種子 : " << stats.Seed << "，串流 " << stats.RngStream << "\n";
+    report << "  搜尋引擎 : " << searchEngineName(stats.Engine) << "\n";
+    if (stats.Engine == SearchEngine::Exact) {
+        report << "  分支定界 : 節點 " << stats.ExactNodes << "，" << (stats.ExactOptimal ? "已證明最佳" : "未證明最佳") << "\n";
+    }
+    if (stats.Engine == SearchEngine::Tabu) {
+        report << "  禁忌搜尋 : 評估 " << stats.TabuEvaluations << " 個移動，禁忌排除 " << stats.TabuRejected
+            << "，特赦 " << stats.TabuAspirations << "，禁忌期 " << stats.TabuTenure << "\n";
+    }
+    report << "  批次重排 : " << stats.ResequencedMachines << " 台機台，改進 " << stats.ResequenceGain << "\n";
+    report << "  置換表 : 查詢 " << stats.TranspositionLookups << "，命中 " << stats.TranspositionHits
+        << "，拒絕重複訪問 " << stats.RevisitsRejected << "\n";
+    report << "  退火溫度 : " << stats.InitialTemperature << " → " << stats.FinalTemperature
+        << "，回溫 " << stats.Reheats << " 次\n";
+    report << "  方法權重 :";
+    for (double weight : stats.MethodWeights) {
+        report << " " << weight;
+    }
+    report << "\n";
+    report << "  每次迭代配置 : " << stats.allocationsPerIteration() << " 次, " << stats.bytesPerIteration() << " 位元組\n";
+    report << "**********************************" << "\n";
+    if (stats.PerfEnabled) {
+        report << "硬體計數器 (cycles, instructions, IPC, cache misses, branch misses) :\n";
+        for (int phase = 0; phase < PerfReport; phase++) {
+            const PerfSample& sample = stats.Perf[phase];
+            double ipc = sample.Cycles > 0 ? static_cast<double>(sample.Instructions) / sample.Cycles : 0.0;
+            report << "  " << perfPhaseNames[phase] << " : " << static_cast<long long>(sample.Cycles) << ", "
+                << static_cast<long long>(sample.Instructions) << ", " << ipc << ", "
+                << static_cast<long long>(sample.CacheMisses) << ", " << static_cast<long long>(sample.BranchMisses) << "\n";
+        }
+        report << "**********************************" << "\n";
+    }
+    report.flush();
+
+    allTestFile << "檔案 名稱：" << stats.InstanceName << "\n";
+    allTestFile << "  初始解 : " << stats.InitialResult << "\n";
+    allTestFile << "  最佳解 : " << stats.BestResult << "\n";
+}
+
+// 有界阻塞佇列，用於載入 → 求解 → 輸出三個階段之間，限制預先載入與待寫出的實例數量
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)), closed(false) {}
+
+    // 佇列已滿時等待；佇列已關閉時回傳 false
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // 佇列為空時等待；已關閉且取完時回傳 false
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+};
+
+
+// 檔名萬用字元比對 (支援 * 與 ?)
+bool matchesWildcard(const std::string& pattern, const std::string& text)
+{
+    size_t p = 0, t = 0;
+    size_t starPos = std::string::npos, starText = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            ++p;
+            ++t;
+        }
+        else if (p < pattern.size() && pattern[p] == '*') {
+            starPos = p++;
+            starText = t;
+        }
+        else if (starPos != std::string::npos) {
+            p = starPos + 1;
+            t = ++starText;
+        }
+        else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+// 將輸入 (檔案、資料夾或檔名含萬用字元的路徑) 展開為排序後的 JSON 檔清單
+std::vector<std::string> expandInputs(const std::vector<std::string>& inputs)
+{
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+
+    for (const auto& input : inputs) {
+        fs::path inputPath(input);
+        std::string fileName = inputPath.filename().string();
+
+        if (fileName.find_first_of("*?") != std::string::npos) {
+            fs::path directory = inputPath.has_parent_path() ? inputPath.parent_path() : fs::path(".");
+            if (!fs::is_directory(directory)) {
+                throw std::runtime_error("Input directory not found: " + directory.string());
+            }
+            for (const auto& entry : fs::directory_iterator(directory)) {
+                if (entry.is_regular_file() && matchesWildcard(fileName, entry.path().filename().string())) {
+                    files.push_back(entry.path().generic_string());
+                }
+            }
+        }
+        else if (fs::is_directory(inputPath)) {
+            for (const auto& entry : fs::directory_iterator(inputPath)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".json") {
+                    files.push_back(entry.path().generic_string());
+                }
+            }
+        }
+        else if (fs::is_regular_file(inputPath)) {
+            files.push_back(inputPath.generic_string());
+        }
+        else {
+            throw std::runtime_error("Input not found: " + input);
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+struct DriverOptions
+{
+    std::vector<std::string> inputs;
+    std::string outputDir = "output";
+    int threads = 1;
+    double timeBudgetSeconds = 0.0; // 整批實例的時間預算，0 表示不限制
+    size_t queueDepth = 0;          // 階段之間佇列的容量，0 表示與執行緒數相同
+    std::string resultsPath;
+    SolveOptions solve;
+    std::string tracePath;
+    bool benchmark = false;
+    bool microbenchmark = false;
+    bool selfCheck = false;
+    int benchPerFamily = 2;
+    unsigned benchSeed = 12345;
+    std::string baselineOutPath;       // 空字串時寫到 <out>/baseline.json
+    std::string comparePath;
+    double throughputTolerance = 0.10; // 每秒迭代數可接受的下降比例
+    double objectiveTolerance = 0.05;  // 平均最佳解可接受的上升比例
+    std::string generateDir;           // 非空時改為產生合成實例
+    std::vector<int> generateOrders{ 8 };
+    std::vector<int> generateItemsPerOrder{ 15 };
+    std::vector<int> generateMachines{ 7 };
+    std::vector<int> generateMaterials{ 2 };
+    std::vector<int> generateTardyPercent{ 30 };
+    std::vector<int> generateDueDateRange{ 250 };
+    int generateCount = 1;
+    unsigned generateSeed = 1;
+    bool scaling = false;
+    int scalingSteps = 5;              // 訂單數加倍的次數
+};
+
+void printUsage(const char* program)
+{
+    std::cout
+        << "Usage: " << program << " [options] [input ...]\n"
+        << "  input                  JSON file, directory, or file pattern such as test/*_m7_*.json (default: test)\n"
+        << "  --out <dir>            output directory for reports and allTest.txt (default: output)\n"
+        << "  --threads <n>          number of solver threads (default: 1)\n"
+        << "  --time-budget <sec>    stop starting new instances after this many seconds (default: unlimited)\n"
+        << "  --instance-time <sec>  search each instance until this deadline instead of a fixed iteration count\n"
+        << "  --stall-iters <n>      stop an instance after n iterations without improving its best objective\n"
+        << "  --rate-window <n>      with --min-improvement, stop when the best objective improved by less than\n"
+        << "  --min-improvement <f>  the fraction f over the last n iterations (e.g. 0.001); give both or neither\n"
+        << "  --reheat-after <n>     reheat the annealing schedule after n iterations without a new best\n"
+        << "                         (default: 1/20 of the iteration budget, at least 100; 200 with --instance-time)\n"
+        << "  --queue-depth <n>      instances buffered between load, solve and write stages (default: threads)\n"
+        << "  --results <path>       also write one JSONL (or .csv) row per instance\n"
+        << "  --save-schedule <dir>  write the best schedule of each instance to <dir>\n"
+        << "  --warm-start <dir>     start from schedules previously saved in <dir>\n"
+        << "  --bench                run the benchmark suite and write <out>/benchmark.txt\n"
+        << "  --bench-per-family <n> instances per family in the benchmark subset (default: 2)\n"
+        << "  --engine <name>        improvement engine: annealing (default), tabu or exact (branch and bound)\n"
+        << "  --exact-nodes <n>      node limit for --engine exact; reports the remaining gap when hit (default: 20000000)\n"
+        << "  --exact-threads <n>    branch-and-bound threads per instance for --engine exact, on top of --threads;\n"
+        << "                         each thread prunes with its own dominance table (default: 1)\n"
+        << "  --reseq-threshold <n>  reorder batches exactly on machines with at most n batches, 0..20;\n"
+        << "                         longer machines use adjacent swaps (default: 16)\n"
+        << "  --tabu-tenure <n>      tabu tenure in iterations (default: parts / 10 + machines, at least 5)\n"
+        << "  --tabu-samples <n>     moves sampled per tabu iteration (default: 64)\n"
+        << "  --tt-entries <n>       transposition table slots, rounded up to a power of two; 0 disables (default: 65536)\n"
+        << "  --seed <n>             seed for the search; each instance gets its own stream (default: 1)\n"
+        << "  --bench-seed <n>       seed used to pick the benchmark subset (default: 12345)\n"
+        << "  --baseline-out <file>  where --bench writes its baseline (default: <out>/baseline.json)\n"
+        << "  --compare <file>       run the benchmark and compare it per family with a saved baseline;\n"
+        << "                         exits with status 2 when a family regresses; the baseline must use the same\n"
+        << "                         --bench-seed, --bench-per-family, --seed and search options (engine, time limits,\n"
+        << "                         stop rules, table, tabu, exact and resequencing settings), and is never overwritten\n"
+        << "  --throughput-tolerance <f>  allowed drop in iterations per second (default: 0.10)\n"
+        << "  --objective-tolerance <f>   allowed rise in the mean best objective (default: 0.05)\n"
+        << "  --microbench           measure the evaluation kernels on synthetic batches, write <out>/microbench.txt\n"
+        << "  --self-check           verify incrementally maintained values against a full recomputation on\n"
+        << "                         generated instances, write <out>/selfcheck.txt; exits with status 1 on a mismatch\n"
+        << "  --generate <dir>       write synthetic instances to <dir> instead of solving\n"
+        << "  --gen-orders <n,...>   orders per generated instance (default: 8)\n"
+        << "  --gen-ipo <n,...>      items per order (default: 15)\n"
+        << "  --gen-machines <n,...> machines (default: 7)\n"
+        << "  --gen-materials <n,...> materials (default: 2)\n"
+        << "  --gen-tardy <n,...>    percentage of tardy orders, pT (default: 30)\n"
+        << "  --gen-ddr <n,...>      due date range in percent, ddr (default: 250)\n"
+        << "  --gen-count <n>        instances per combination of the lists above (default: 1)\n"
+        << "  --gen-seed <n>         generator seed (default: 1)\n"
+        << "  --scaling              time construction, reintegration, reinsertion and one iteration on generated\n"
+        << "                         instances with doubling orders (from --gen-orders) and fit growth exponents\n"
+        << "  --scaling-steps <n>    number of sizes in the scaling study (default: 5)\n"
+        << "  --trace <file>         write a Chrome trace-event timeline (load, construction, steps, methods, report)\n"
+        << "  --perf-counters        record cycles, instructions, cache and branch misses per solver phase (Linux)\n";
+}
+
+DriverOptions parseArguments(int argc, char* argv[])
+{
+    DriverOptions options;
+    auto requireValue = [&](int& i, const std::string& arg) -> std::string {
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for " + arg);
+        }
+        return argv[++i];
+    };
+    // 逗號分隔的正整數清單，例如 50,100,200
+    auto requireList = [&](int& i, const std::string& arg) {
+        std::vector<int> values;
+        std::stringstream list(requireValue(i, arg));
+        std::string item;
+        while (std::getline(list, item, ',')) {
+            values.push_back(std::stoi(item));
+            if (values.back() < 0) {
+                throw std::invalid_argument(arg + " values must not be negative");
+            }
+        }
+        if (values.empty()) {
+            throw std::invalid_argument("Missing value for " + arg);
+        }
+        return values;
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--out") {
+            options.outputDir = requireValue(i, arg);
+        }
+        else if (arg == "--threads") {
+            options.threads = std::stoi(requireValue(i, arg));
+            if (options.threads < 1) {
+                throw std::invalid_argument("--threads must be at least 1");
+            }
+        }
+        else if (arg == "--time-budget") {
+            options.timeBudgetSeconds = std::stod(requireValue(i, arg));
+        }
+        else if (arg == "--queue-depth") {
+            options.queueDepth = static_cast<size_t>(std::stoul(requireValue(i, arg)));
+        }
+        else if (arg == "--results") {
+            options.resultsPath = requireValue(i, arg);
+        }
+        else if (arg == "--save-schedule") {
+            options.solve.saveScheduleDir = requireValue(i, arg);
+        }
+        else if (arg == "--instance-time") {
+            options.solve.instanceTimeSeconds = std::stod(requireValue(i, arg));
+            if (options.solve.instanceTimeSeconds <= 0) {
+                throw std::invalid_argument("--instance-time must be positive");
+            }
+        }
+        else if (arg == "--stall-iters") {
+            options.solve.stallIterations = std::stoll(requireValue(i, arg));
+        }
+        else if (arg == "--rate-window") {
+            options.solve.rateWindow = std::stoll(requireValue(i, arg));
+        }
+        else if (arg == "--min-improvement") {
+            options.solve.minImprovementRate = std::stod(requireValue(i, arg));
+        }
+        else if (arg == "--reheat-after") {
+            options.solve.reheatAfter = std::stoll(requireValue(i, arg));
+        }
+        else if (arg == "--warm-start") {
+            options.solve.warmStartDir = requireValue(i, arg);
+        }
+        else if (arg == "--bench") {
+            options.benchmark = true;
+        }
+        else if (arg == "--microbench") {
+            options.microbenchmark = true;
+        }
+        else if (arg == "--self-check") {
+            options.selfCheck = true;
+        }
+        else if (arg == "--trace") {
+            options.tracePath = requireValue(i, arg);
+        }
+        else if (arg == "--perf-counters") {
+            options.solve.perfCounters = true;
+        }
+        else if (arg == "--bench-per-family") {
+            options.benchPerFamily = std::stoi(requireValue(i, arg));
+            if (options.benchPerFamily < 1) {
+                throw std::invalid_argument("--bench-per-family must be at least 1");
+            }
+        }
+        else if (arg == "--engine") {
+            options.solve.engine = parseSearchEngine(requireValue(i, arg));
+        }
+        else if (arg == "--exact-nodes") {
+            options.solve.exactNodeLimit = std::stoll(requireValue(i, arg));
+            if (options.solve.exactNodeLimit < 1) {
+                throw std::invalid_argument("--exact-nodes must be at least 1");
+            }
+        }
+        else if (arg == "--exact-threads") {
+            options.solve.exactThreads = std::stoi(requireValue(i, arg));
+            if (options.solve.exactThreads < 1) {
+                throw std::invalid_argument("--exact-threads must be at least 1");
+            }
+        }
+        else if (arg == "--reseq-threshold") {
+            options.solve.resequenceThreshold = std::stoi(requireValue(i, arg));
+            if (options.solve.resequenceThreshold < 0 || options.solve.resequenceThreshold > MaxResequenceBatches) {
+                throw std::invalid_argument("--reseq-threshold must be between 0 and " + std::to_string(MaxResequenceBatches));
+            }
+        }
+        else if (arg == "--tabu-tenure") {
+            options.solve.tabuTenure = std::stoll(requireValue(i, arg));
+        }
+        else if (arg == "--tabu-samples") {
+            options.solve.tabuSamples = std::stoi(requireValue(i, arg));
+            if (options.solve.tabuSamples < 1) {
+                throw std::invalid_argument("--tabu-samples must be at least 1");
+            }
+        }
+        else if (arg == "--tt-entries") {
+            options.solve.transpositionEntries = static_cast<size_t>(std::stoull(requireValue(i, arg)));
+        }
+        else if (arg == "--seed") {
+            options.solve.seed = std::stoull(requireValue(i, arg));
+        }
+        else if (arg == "--bench-seed") {
+            options.benchSeed = static_cast<unsigned>(std::stoul(requireValue(i, arg)));
+        }
+        else if (arg == "--baseline-out") {
+            options.baselineOutPath = requireValue(i, arg);
+        }
+        else if (arg == "--compare") {
+            options.comparePath = requireValue(i, arg);
+            options.benchmark = true;
+        }
+        else if (arg == "--generate") {
+            options.generateDir = requireValue(i, arg);
+        }
+        else if (arg == "--gen-orders") {
+            options.generateOrders = requireList(i, arg);
+        }
+        else if (arg == "--gen-ipo") {
+            options.generateItemsPerOrder = requireList(i, arg);
+        }
+        else if (arg == "--gen-machines") {
+            options.generateMachines = requireList(i, arg);
+        }
+        else if (arg == "--gen-materials") {
+            options.generateMaterials = requireList(i, arg);
+        }
+        else if (arg == "--gen-tardy") {
+            options.generateTardyPercent = requireList(i, arg);
+        }
+        else if (arg == "--gen-ddr") {
+            options.generateDueDateRange = requireList(i, arg);
+        }
+        else if (arg == "--gen-count") {
+            options.generateCount = std::stoi(requireValue(i, arg));
+        }
+        else if (arg == "--gen-seed") {
+            options.generateSeed = static_cast<unsigned>(std::stoul(requireValue(i, arg)));
+        }
+        else if (arg == "--scaling") {
+            options.scaling = true;
+        }
+        else if (arg == "--scaling-steps") {
+            options.scalingSteps = std::stoi(requireValue(i, arg));
+            if (options.scalingSteps < 2) {
+                throw std::invalid_argument("--scaling-steps must be at least 2");
+            }
+        }
+        else if (arg == "--throughput-tolerance") {
+            options.throughputTolerance = std::stod(requireValue(i, arg));
+        }
+        else if (arg == "--objective-tolerance") {
+            options.objectiveTolerance = std::stod(requireValue(i, arg));
+        }
+        else if (arg.rfind("--", 0) == 0) {
+            throw std::invalid_argument("Unknown option " + arg);
+        }
+        else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    // 改進率規則需要視窗與門檻兩者，只給一個時不會生效
+    if ((options.solve.rateWindow > 0) != (options.solve.minImprovementRate > 0)) {
+        throw std::invalid_argument("--rate-window and --min-improvement must be given together");
+    }
+    if (options.inputs.empty()) {
+        options.inputs.push_back("test");
+    }
+    return options;
+}
+
+// 實例族的鍵值 (不含 id)，例如 o4_ipo5_m2_m2_pT30_ddr50
+std::string familyKey(const InstanceFamily& family)
+{
+    return "o" + std::to_string(family.Orders) +
+        "_ipo" + std::to_string(family.ItemsPerOrder) +
+        "_m" + std::to_string(family.Machines) +
+        "_m" + std::to_string(family.Materials) +
+        "_pT" + std::to_string(family.TardyPercent) +
+        "_ddr" + std::to_string(family.DueDateRange);
+}
+
+struct BenchmarkAggregate
+{
+    int Instances = 0;
+    double WallSeconds = 0.0;
+    long long Iterations = 0;
+    double BestSum = 0.0;
+    double ImprovementSum = 0.0; // (初始解 - 最佳解) / 初始解 的總和
+    unsigned long long Allocations = 0;
+    unsigned long long Bytes = 0;
+
+    void add(const SolveStats& stats)
+    {
+        Instances++;
+        WallSeconds += stats.WallSeconds;
+        Iterations += stats.Iterations;
+        BestSum += stats.BestResult;
+        ImprovementSum += stats.InitialResult > 0 ? (stats.InitialResult - stats.BestResult) / stats.InitialResult : 0.0;
+        Allocations += stats.SearchAllocations;
+        Bytes += stats.SearchBytes;
+    }
+
+    double meanWallSeconds() const { return Instances ? WallSeconds / Instances : 0.0; }
+    double iterationsPerSecond() const { return WallSeconds > 0 ? Iterations / WallSeconds : 0.0; }
+    double meanBest() const { return Instances ? BestSum / Instances : 0.0; }
+    double meanImprovementPercent() const { return Instances ? ImprovementSum / Instances * 100.0 : 0.0; }
+    double allocationsPerIteration() const { return Iterations > 0 ? static_cast<double>(Allocations) / Iterations : 0.0; }
+    double kilobytesPerIteration() const { return Iterations > 0 ? static_cast<double>(Bytes) / Iterations / 1024.0 : 0.0; }
+};
+
+void printBenchmarkTable(const std::string& title, const std::map<std::string, BenchmarkAggregate>& rows, std::ostream& out)
+{
+    out << title << "\n";
+    out << std::left << std::setw(28) << "  key" << std::right
+        << std::setw(6) << "n"
+        << std::setw(14) << "wall_s/inst"
+        << std::setw(14) << "iter/s"
+        << std::setw(14) << "best(mean)"
+        << std::setw(14) << "improve%"
+        << std::setw(14) << "alloc/iter"
+        << std::setw(14) << "KiB/iter" << "\n";
+    for (const auto& row : rows) {
+        const BenchmarkAggregate& aggregate = row.second;
+        out << std::left << std::setw(28) << ("  " + row.first) << std::right
+            << std::setw(6) << aggregate.Instances
+            << std::setw(14) << aggregate.meanWallSeconds()
+            << std::setw(14) << aggregate.iterationsPerSecond()
+            << std::setw(14) << aggregate.meanBest()
+            << std::setw(14) << aggregate.meanImprovementPercent()
+            << std::setw(14) << aggregate.allocationsPerIteration()
+            << std::setw(14) << aggregate.kilobytesPerIteration() << "\n";
+    }
+    out << "\n";
+}
+
+// 基準檔：每次 --bench 結束時寫出各實例族的彙總，供之後的 --compare 比對。
+// 欄位有變動時遞增 baselineFormatVersion，舊版檔案會被拒絕而不是被誤讀。
+const char* const baselineFormatName = "benchmark-baseline";
+const int baselineFormatVersion = 2;
+
+// 會影響解或吞吐量的選項，寫入基準檔並在 --compare 時逐項比對。
+// 固定迭代數由實例大小決定 (instance_time 為 0 時)，因此只要 instance_time 相同迭代預算就相同
+json baselineSettings(const DriverOptions& options)
+{
+    const SolveOptions& solve = options.solve;
+    return {
+        {"engine", searchEngineName(solve.engine)},
+        {"instance_time", solve.instanceTimeSeconds},
+        {"time_budget", options.timeBudgetSeconds},
+        {"threads", options.threads},
+        {"stall_iters", solve.stallIterations},
+        {"rate_window", solve.rateWindow},
+        {"min_improvement", solve.minImprovementRate},
+        {"reheat_after", solve.reheatAfter},
+        {"tt_entries", solve.transpositionEntries},
+        {"tabu_tenure", solve.tabuTenure},
+        {"tabu_samples", solve.tabuSamples},
+        {"exact_nodes", solve.exactNodeLimit},
+        {"exact_threads", solve.exactThreads},
+        {"reseq_threshold", solve.resequenceThreshold},
+        {"warm_start", solve.warmStartDir},
+        {"perf_counters", solve.perfCounters}
+    };
+}
+
+void writeBaseline(const std::string& path, const DriverOptions& options, const std::map<std::string, BenchmarkAggregate>& byFamily)
+{
+    json families = json::object();
+    for (const auto& row : byFamily) {
+        const BenchmarkAggregate& aggregate = row.second;
+        families[row.first] = {
+            {"instances", aggregate.Instances},
+            {"mean_wall_seconds", aggregate.meanWallSeconds()},
+            {"iterations_per_second", aggregate.iterationsPerSecond()},
+            {"mean_best", aggregate.meanBest()},
+            {"mean_improvement_percent", aggregate.meanImprovementPercent()},
+            {"allocations_per_iteration", aggregate.allocationsPerIteration()}
+        };
+    }
+
+    json baseline;
+    baseline["format"] = baselineFormatName;
+    baseline["version"] = baselineFormatVersion;
+    baseline["created"] = static_cast<long long>(std::time(nullptr));
+    baseline["bench_seed"] = options.benchSeed;
+    baseline["seed"] = options.solve.seed;
+    baseline["bench_per_family"] = options.benchPerFamily;
+    baseline["settings"] = baselineSettings(options);
+    baseline["families"] = families;
+
+    std::ofstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot write baseline " + path);
+    }
+    file << baseline.dump(2) << "\n";
+}
+
+json loadBaseline(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open baseline " + path);
+    }
+    json baseline = json::parse(file);
+    if (baseline.value("format", std::string()) != baselineFormatName) {
+        throw std::runtime_error(path + " is not a benchmark baseline");
+    }
+    if (baseline.value("version", 0) != baselineFormatVersion) {
+        throw std::runtime_error(path + " has baseline version " + std::to_string(baseline.value("version", 0))
+            + ", expected " + std::to_string(baselineFormatVersion));
+    }
+    return baseline;
+}
+
+// 子集種子、每族數量、搜尋種子或任何 baselineSettings 的選項不同時，兩次執行解的不是同一個問題或用的不是同一個搜尋，
+// 比對沒有意義，直接拒絕
+void checkBaselineMatchesRun(const json& baseline, const std::string& path, const DriverOptions& options)
+{
+    auto mismatch = [&](const char* field, const std::string& expected) {
+        throw std::runtime_error(path + " was recorded with " + field + " "
+            + (baseline.contains(field) ? baseline.at(field).dump() : std::string("(missing)"))
+            + ", this run uses " + expected);
+    };
+    if (!baseline.contains("bench_seed") || baseline.at("bench_seed").get<unsigned>() != options.benchSeed) {
+        mismatch("bench_seed", std::to_string(options.benchSeed));
+    }
+    if (!baseline.contains("bench_per_family") || baseline.at("bench_per_family").get<int>() != options.benchPerFamily) {
+        mismatch("bench_per_family", std::to_string(options.benchPerFamily));
+    }
+    if (!baseline.contains("seed") || baseline.at("seed").get<std::uint64_t>() != options.solve.seed) {
+        mismatch("seed", std::to_string(options.solve.seed));
+    }
+    json settings = baselineSettings(options);
+    json recorded = baseline.value("settings", json::object());
+    for (auto it = settings.begin(); it != settings.end(); ++it) {
+        if (!recorded.contains(it.key()) || recorded.at(it.key()) != it.value()) {
+            throw std::runtime_error(path + " was recorded with " + it.key() + " "
+                + (recorded.contains(it.key()) ? recorded.at(it.key()).dump() : std::string("(missing)"))
+                + ", this run uses " + it.value().dump());
+        }
+    }
+}
+
+// 逐實例族比對：每秒迭代數下降超過 throughputTolerance，或平均最佳解上升超過 objectiveTolerance 即視為退步。
+// 回傳退步的實例族數量
+int compareWithBaseline(const json& baseline, const std::map<std::string, BenchmarkAggregate>& byFamily,
+    double throughputTolerance, double objectiveTolerance, std::ostream& out)
+{
+    const json& families = baseline.at("families");
+    out << "Baseline subset seed " << baseline.value("bench_seed", 0u)
+        << ", " << baseline.value("bench_per_family", 0) << " per family\n";
+    out << "Tolerances: throughput -" << throughputTolerance * 100.0 << "%, objective +" << objectiveTolerance * 100.0 << "%\n\n";
+    out << std::left << std::setw(28) << "  family" << std::right
+        << std::setw(14) << "iter/s base"
+        << std::setw(14) << "iter/s now"
+        << std::setw(10) << "chg%"
+        << std::setw(14) << "best base"
+        << std::setw(14) << "best now"
+        << std::setw(10) << "chg%" << "  status\n";
+
+    auto percentChange = [](double base, double now) {
+        return base != 0.0 ? (now - base) / std::abs(base) * 100.0 : 0.0;
+    };
+
+    int regressions = 0;
+    for (const auto& row : byFamily) {
+        const BenchmarkAggregate& aggregate = row.second;
+        if (!families.contains(row.first)) {
+            out << std::left << std::setw(28) << ("  " + row.first) << std::right << "  (not in baseline)\n";
+            continue;
+        }
+        const json& base = families.at(row.first);
+        double baseThroughput = base.value("iterations_per_second", 0.0);
+        double baseBest = base.value("mean_best", 0.0);
+        double throughput = aggregate.iterationsPerSecond();
+        double best = aggregate.meanBest();
+
+        // 最佳解可能為 0，因此目標值另外給一個極小的絕對容許量
+        bool slower = baseThroughput > 0 && throughput < baseThroughput * (1.0 - throughputTolerance);
+        bool worse = best > baseBest + std::abs(baseBest) * objectiveTolerance + 1e-9;
+        std::string status = "ok";
+        if (slower || worse) {
+            regressions++;
+            status = slower && worse ? "SLOWER, WORSE" : (slower ? "SLOWER" : "WORSE");
+        }
+
+        out << std::left << std::setw(28) << ("  " + row.first) << std::right
+            << std::setw(14) << baseThroughput
+            << std::setw(14) << throughput
+            << std::setw(10) << percentChange(baseThroughput, throughput)
+            << std::setw(14) << baseBest
+            << std::setw(14) << best
+            << std::setw(10) << percentChange(baseBest, best)
+            << "  " << status << "\n";
+    }
+    for (const auto& family : families.items()) {
+        if (byFamily.find(family.key()) == byFamily.end()) {
+            out << std::left << std::setw(28) << ("  " + family.key()) << std::right << "  (missing from this run)\n";
+        }
+    }
+    out << "\n" << regressions << " regressed famil" << (regressions == 1 ? "y" : "ies") << "\n";
+    return regressions;
+}
+
+// 基準測試模式：每個實例族以固定種子挑選固定的子集，逐一求解 (不寫報告)，
+// 依實例族與各個維度彙總牆鐘時間、每秒迭代數與解的品質
+int runBenchmark(const DriverOptions& options, const std::vector<std::string>& inputFiles, ResultsSink* resultsSink)
+{
+    // 比對用的基準檔在求解前就讀入並檢查，之後寫出的新基準檔也不會蓋掉它
+    json compareBaseline;
+    std::string baselinePath = options.baselineOutPath.empty() ? options.outputDir + "/baseline.json" : options.baselineOutPath;
+    bool writeNewBaseline = true;
+    if (!options.comparePath.empty()) {
+        try {
+            compareBaseline = loadBaseline(options.comparePath);
+            checkBaselineMatchesRun(compareBaseline, options.comparePath, options);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+        std::error_code ec;
+        if (std::filesystem::exists(baselinePath) && std::filesystem::equivalent(baselinePath, options.comparePath, ec)) {
+            std::cerr << "Not writing " << baselinePath << ": it is the baseline being compared against\n";
+            writeNewBaseline = false;
+        }
+    }
+
+    std::map<std::string, std::vector<std::string>> filesByFamily;
+    for (const auto& file : inputFiles) {
+        filesByFamily[familyKey(parseInstanceFamily(file))].push_back(file);
+    }
+
+    std::vector<std::string> selected;
+    std::mt19937 subsetRng(options.benchSeed);
+    for (auto& entry : filesByFamily) {
+        auto files = entry.second;
+        std::shuffle(files.begin(), files.end(), subsetRng);
+        size_t count = std::min<size_t>(files.size(), static_cast<size_t>(options.benchPerFamily));
+        std::sort(files.begin(), files.begin() + count);
+        selected.insert(selected.end(), files.begin(), files.begin() + count);
+    }
+
+    std::map<std::string, BenchmarkAggregate> byFamily;
+    std::vector<std::pair<std::string, std::map<std::string, BenchmarkAggregate>>> byAxis = {
+        { "orders", {} }, { "items_per_order", {} }, { "machines", {} },
+        { "materials", {} }, { "tardy_percent", {} }, { "due_date_range", {} },
+    };
+    bool failed = false;
+
+    for (const auto& file : selected) {
+        try {
+            SolveResult solveResult = solveInstance(loadInstance(file, options.solve), options.solve);
+            const SolveStats& stats = solveResult.stats;
+            const InstanceFamily& family = stats.Family;
+
+            byFamily[familyKey(family)].add(stats);
+            int axisValues[] = { family.Orders, family.ItemsPerOrder, family.Machines,
+                family.Materials, family.TardyPercent, family.DueDateRange };
+            for (size_t axis = 0; axis < byAxis.size(); ++axis) {
+                byAxis[axis].second[std::to_string(axisValues[axis])].add(stats);
+            }
+
+            if (resultsSink) {
+                resultsSink->write(stats);
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Failed to benchmark " << file << ": " << e.what() << "\n";
+            failed = true;
+        }
+    }
+
+    std::ostringstream table;
+    table << "Benchmark: " << selected.size() << " instances, " << options.benchPerFamily
+        << " per family, subset seed " << options.benchSeed << "\n\n";
+    printBenchmarkTable("Per family", byFamily, table);
+    for (const auto& axis : byAxis) {
+        printBenchmarkTable("By " + axis.first, axis.second, table);
+    }
+
+    std::ofstream benchmarkFile(options.outputDir + "/benchmark.txt");
+    benchmarkFile << table.str();
+    std::cout << table.str();
+
+    try {
+        if (writeNewBaseline) {
+            writeBaseline(baselinePath, options, byFamily);
+        }
+
+        if (!options.comparePath.empty()) {
+            std::ostringstream comparison;
+            comparison << "Comparison with " << options.comparePath << "\n";
+            int regressions = compareWithBaseline(compareBaseline, byFamily,
+                options.throughputTolerance, options.objectiveTolerance, comparison);
+            std::ofstream comparisonFile(options.outputDir + "/comparison.txt");
+            comparisonFile << comparison.str();
+            std::cout << comparison.str();
+            if (regressions > 0) {
+                return 2;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return failed ? 1 : 0;
+}
+
+// 丟棄所有輸出的 streambuf，讓微基準測試保留核心函式內 std::cout 的格式化成本但不寫終端機
+class NullStreamBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+struct MicrobenchmarkResult
+{
+    std::string Kernel;
+    int BatchesPerMachine;
+    int PartsPerBatch;
+    double NanosecondsPerOp;
+    double AllocationsPerOp;
+};
+
+// 重複執行 op 直到累積至少 minSeconds，回傳每次的平均時間與配置次數
+template <typename Op>
+MicrobenchmarkResult measureKernel(const std::string& kernel, int batchesPerMachine, int partsPerBatch, Op op, double minSeconds = 0.05)
+{
+    op(); // 暖機
+
+    long long iterations = 0;
+    unsigned long long allocationsBefore = allocationCounters.Allocations;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    long long batchSize = 1;
+    while (elapsed < minSeconds) {
+        for (long long i = 0; i < batchSize; ++i) {
+            op();
+        }
+        iterations += batchSize;
+        batchSize *= 2;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    unsigned long long allocations = allocationCounters.Allocations - allocationsBefore;
+
+    return { kernel, batchesPerMachine, partsPerBatch,
+        elapsed * 1e9 / iterations,
+        static_cast<double>(allocations) / iterations };
+}
+
+// 合成的機台與批次，零件尺寸以固定種子產生，確保每次量測資料相同
+struct SyntheticSchedule
+{
+    std::vector<PartType> partTypes;
+    std::vector<std::pair<int, Machine>> sortedMachines;
+    std::vector<MachineBatch> machineBatches;
+};
+
+SyntheticSchedule makeSyntheticSchedule(int machineCount, int batchesPerMachine, int partsPerBatch)
+{
+    SyntheticSchedule schedule;
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> sizeDist(1.0, 40.0);
+    std::uniform_real_distribution<double> dueDist(0.0, 2000.0);
+
+    schedule.partTypes.resize(32);
+    for (int i = 0; i < static_cast<int>(schedule.partTypes.size()); ++i) {
+        PartType& partType = schedule.partTypes[i];
+        partType.PartTypeId = i;
+        partType.Height = sizeDist(generator);
+        partType.Length = sizeDist(generator);
+        partType.Width = 1;
+        partType.Area = partType.Length * partType.Width;
+        partType.Volume = partType.Area * partType.Height;
+    }
+
+    for (int m = 0; m < machineCount; ++m) {
+        Machine machine;
+        machine.MachineId = m;
+        machine.Area = 1e12; // 不受面積限制，批次大小完全由參數決定
+        machine.Height = machine.Length = machine.Width = 0;
+        machine.Materials = { 0, 1 };
+        machine.MaterialSetup = { { 1.5, 1.9 }, { 1.1, 1.4 } };
+        machine.StartSetup = { 1.0, 1.3 };
+        machine.ScanTime = 0.03 + 0.005 * m;
+        machine.RecoatTime = 0.5;
+        machine.RemovalTime = 0;
+        schedule.sortedMachines.emplace_back(m, machine);
+    }
+
+    int nextBatchId = 0;
+    for (int m = 0; m < machineCount; ++m) {
+        MachineBatch machineBatch{ m, schedule.sortedMachines[m].second.Area, 0.0, 0.0 };
+        for (int b = 0; b < batchesPerMachine; ++b) {
+            Batch batch;
+            batch.batchId = nextBatchId++;
+            batch.materialType = b % 2;
+            batch.totalArea = 0.0;
+            for (int p = 0; p < partsPerBatch; ++p) {
+                PartTypeOrderInfo partInfo;
+                partInfo.machineID = m;
+                partInfo.batchId = batch.batchId;
+                partInfo.Material = batch.materialType;
+                partInfo.partType = &schedule.partTypes[generator() % schedule.partTypes.size()];
+                partInfo.orderInfo = { static_cast<int>(generator() % 8), dueDist(generator), 0.0, 0.5 + (generator() % 100) / 100.0 };
+                batch.parts.push_back(partInfo);
+                batch.totalArea += partInfo.partType->Area;
+            }
+            machineBatch.Batches.push_back(batch);
+        }
+        schedule.machineBatches.push_back(machineBatch);
+    }
+
+    for (auto& machineBatch : schedule.machineBatches) {
+        updateMachineBatches(machineBatch, schedule.sortedMachines);
+    }
+    return schedule;
+}
+
+// 微基準測試模式：以合成資料分別量測各個評估核心的 ns/op 與 allocations/op
+int runMicrobenchmarks(const DriverOptions& options)
+{
+    NullStreamBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    std::vector<MicrobenchmarkResult> results;
+    volatile double sink = 0.0;
+
+    for (int partsPerBatch : { 1, 10, 100, 1000 }) {
+        SyntheticSchedule schedule = makeSyntheticSchedule(1, 1, partsPerBatch);
+        const Batch& batch = schedule.machineBatches[0].Batches[0];
+        const Machine* machine = &schedule.sortedMachines[0].second;
+
+        results.push_back(measureKernel("calculateFinishTime", 1, partsPerBatch, [&] {
+            sink = sink + calculateFinishTime(batch, machine->MachineId, machine);
+        }));
+        results.push_back(measureKernel("calculateWeightedDelay", 1, partsPerBatch, [&] {
+            sink = sink + calculateWeightedDelay(batch, 1000.0);
+        }));
+    }
+
+    const std::pair<int, int> machineShapes[] = { { 1, 1 }, { 10, 10 }, { 100, 10 }, { 500, 10 }, { 100, 100 }, { 10, 1000 } };
+    for (const auto& shape : machineShapes) {
+        int batchesPerMachine = shape.first;
+        int partsPerBatch = shape.second;
+        SyntheticSchedule schedule = makeSyntheticSchedule(2, batchesPerMachine, partsPerBatch);
+        MachineBatch& machineBatch = schedule.machineBatches[0];
+        const Batch batchToInsert = schedule.machineBatches[1].Batches[0];
+        PartTypeOrderInfo partInfo = batchToInsert.parts[0];
+        partInfo.orderInfo.DueDate = 1e9; // 讓所有批次都是可行的插入位置
+
+        results.push_back(measureKernel("updateMachineBatches", batchesPerMachine, partsPerBatch, [&] {
+            updateMachineBatches(machineBatch, schedule.sortedMachines);
+            sink = sink + machineBatch.TotalWeightedDelay;
+        }));
+        results.push_back(measureKernel("tryInsertBatch", batchesPerMachine, partsPerBatch, [&] {
+            sink = sink + tryInsertBatch(machineBatch, batchToInsert, batchesPerMachine / 2, schedule.sortedMachines);
+        }));
+        results.push_back(measureKernel("findBestInsertionPosition", batchesPerMachine, partsPerBatch, [&] {
+            auto position = findBestInsertionPosition(schedule.machineBatches, partInfo, schedule.sortedMachines);
+            sink = sink + std::get<0>(position);
+        }));
+    }
+
+    std::cout.rdbuf(coutBuffer);
+
+    std::ostringstream table;
+    table << std::left << std::setw(28) << "kernel" << std::right
+        << std::setw(10) << "batches"
+        << std::setw(8) << "parts"
+        << std::setw(16) << "ns/op"
+        << std::setw(16) << "allocs/op" << "\n";
+    for (const auto& result : results) {
+        table << std::left << std::setw(28) << result.Kernel << std::right
+            << std::setw(10) << result.BatchesPerMachine
+            << std::setw(8) << result.PartsPerBatch
+            << std::setw(16) << std::fixed << std::setprecision(1) << result.NanosecondsPerOp
+            << std::setw(16) << std::setprecision(2) << result.AllocationsPerOp << "\n";
+    }
+
+    std::ofstream microbenchFile(options.outputDir + "/microbench.txt");
+    microbenchFile << table.str();
+    std::cout << table.str();
+    return 0;
+}
+
+// 合成實例產生器：輸出與 read_json 相同格式的 JSON，參數對應檔名中的各個維度。
+// 數值分布參考隨附測試集 (零件高度、面積、體積比例、罰金、訂單明細數)，
+// 交期依照 pT (延遲訂單比例 T) 與 ddr (交期範圍 R) 取 P × U(1 - T - R/2, 1 - T + R/2)，
+// P 為所有零件單獨加工時間總和除以機台數的粗估完工時間。
+json generateInstance(const InstanceFamily& family, unsigned seed)
+{
+    if (family.Orders < 1 || family.ItemsPerOrder < 1 || family.Machines < 1 || family.Materials < 1) {
+        throw std::invalid_argument("Generated instances need at least one order, item, machine and material");
+    }
+
+    std::seed_seq seedSequence{ seed, static_cast<unsigned>(family.Orders), static_cast<unsigned>(family.ItemsPerOrder),
+        static_cast<unsigned>(family.Machines), static_cast<unsigned>(family.Materials),
+        static_cast<unsigned>(family.TardyPercent), static_cast<unsigned>(family.DueDateRange),
+        static_cast<unsigned>(family.InstanceId) };
+    std::mt19937 generator(seedSequence);
+    auto uniform = [&](double low, double high) {
+        return std::uniform_real_distribution<double>(low, high)(generator);
+    };
+    auto uniformInt = [&](int low, int high) {
+        return std::uniform_int_distribution<int>(low, high)(generator);
+    };
+    auto round2 = [](double value) { return std::round(value * 100.0) / 100.0; };
+
+    json instance;
+    instance["InstanceID"] = family.InstanceId;
+    instance["SeedValue"] = seed;
+    instance["nOrders"] = family.Orders;
+    instance["nItemsPerOrder"] = family.ItemsPerOrder;
+    instance["nTotalItems"] = family.Orders * family.ItemsPerOrder;
+    instance["nMachines"] = family.Machines;
+    instance["nMaterials"] = family.Materials;
+    instance["PercentageOfTardyOrders"] = family.TardyPercent / 100.0;
+    instance["DueDateRange"] = family.DueDateRange / 100.0;
+
+    std::vector<int> materials(family.Materials);
+    std::iota(materials.begin(), materials.end(), 0);
+
+    json machines = json::object();
+    double scanSum = 0.0, recoatSum = 0.0;
+    for (int id = 0; id < family.Machines; id++) {
+        double area = 100.0 * uniformInt(8, 12);
+        json setup = json::array();
+        for (int from = 0; from < family.Materials; from++) {
+            json row = json::array();
+            for (int to = 0; to < family.Materials; to++) {
+                row.push_back(round2(uniform(1.0, 2.0)));
+            }
+            setup.push_back(row);
+        }
+        json startSetup = json::array();
+        for (int material = 0; material < family.Materials; material++) {
+            startSetup.push_back(std::round(uniform(1.0, 1.4) * 1000.0) / 1000.0);
+        }
+        double scanTime = std::round(uniform(0.03, 0.045) * 1000.0) / 1000.0;
+        double recoatTime = round2(uniform(0.5, 0.65));
+        scanSum += scanTime;
+        recoatSum += recoatTime;
+
+        machines[std::to_string(id)] = {
+            {"MachineId", id},
+            {"Area", area},
+            {"Height", round2(uniform(25.0, 35.0))},
+            {"Length", area},
+            {"Width", 1},
+            {"Materials", materials},
+            {"MaterialSetup", setup},
+            {"StartSetup", startSetup},
+            {"ScanTime", scanTime},
+            {"RecoatTime", recoatTime},
+            {"RemovalTime", 0}
+        };
+    }
+    instance["Machines"] = machines;
+
+    // 零件種類數與隨附資料相同：每張訂單品項數的兩倍
+    int partTypeCount = 2 * family.ItemsPerOrder;
+    std::vector<double> partVolumes(partTypeCount), partHeights(partTypeCount);
+    json partTypes = json::object();
+    for (int id = 0; id < partTypeCount; id++) {
+        double height = round2(uniform(1.0, 34.0));
+        double area = round2(std::exp(uniform(std::log(30.0), std::log(730.0))));
+        double volume = round2(area * height * uniform(0.1, 0.7));
+        partHeights[id] = height;
+        partVolumes[id] = volume;
+        partTypes[std::to_string(id)] = {
+            {"Height", height},
+            {"Length", area},
+            {"Width", 1},
+            {"Area", area},
+            {"Volume", volume}
+        };
+    }
+    instance["PartTypes"] = partTypes;
+
+    // 每張訂單拆成 1–5 筆明細，數量總和為 ItemsPerOrder
+    std::vector<json> orderLists(family.Orders);
+    double workload = 0.0;
+    double meanScan = scanSum / family.Machines, meanRecoat = recoatSum / family.Machines;
+    for (int order = 0; order < family.Orders; order++) {
+        int lineCount = uniformInt(1, std::min(5, family.ItemsPerOrder));
+        std::vector<int> quantities(lineCount, 1);
+        for (int extra = lineCount; extra < family.ItemsPerOrder; extra++) {
+            quantities[uniformInt(0, lineCount - 1)]++;
+        }
+        json orderList = json::array();
+        for (int quantity : quantities) {
+            int partType = uniformInt(0, partTypeCount - 1);
+            orderList.push_back({
+                {"PartType", partType},
+                {"Quantity", quantity},
+                {"Material", uniformInt(0, family.Materials - 1)},
+                {"Quality", 0}
+            });
+            workload += quantity * (partVolumes[partType] * meanScan + partHeights[partType] * meanRecoat);
+        }
+        orderLists[order] = orderList;
+    }
+
+    double makespan = workload / family.Machines;
+    double tardy = family.TardyPercent / 100.0, range = family.DueDateRange / 100.0;
+    double dueLow = std::max(0.05, 1.0 - tardy - range / 2.0), dueHigh = std::max(dueLow, 1.0 - tardy + range / 2.0);
+    json orders = json::object();
+    for (int order = 0; order < family.Orders; order++) {
+        double penalty = uniform(0.0, 1.0) < 0.15 ? 0.0 : round2(uniform(0.3, 0.9));
+        orders[std::to_string(order)] = {
+            {"OrderId", order},
+            {"DueDate", round2(makespan * uniform(dueLow, dueHigh))},
+            {"ReleaseDate", 0},
+            {"PenaltyCost", penalty},
+            {"OrderList", orderLists[order]}
+        };
+    }
+    instance["Orders"] = orders;
+    return instance;
+}
+
+// 產生模式：對每個參數清單的笛卡兒積各產生 generateCount 個實例，檔名沿用隨附資料的命名規則
+int runGenerator(const DriverOptions& options)
+{
+    std::filesystem::create_directories(options.generateDir);
+    int written = 0;
+    for (int orders : options.generateOrders)
+    for (int itemsPerOrder : options.generateItemsPerOrder)
+    for (int machines : options.generateMachines)
+    for (int materials : options.generateMaterials)
+    for (int tardyPercent : options.generateTardyPercent)
+    for (int dueDateRange : options.generateDueDateRange)
+    for (int id = 0; id < options.generateCount; id++) {
+        InstanceFamily family;
+        family.Orders = orders;
+        family.ItemsPerOrder = itemsPerOrder;
+        family.Machines = machines;
+        family.Materials = materials;
+        family.TardyPercent = tardyPercent;
+        family.DueDateRange = dueDateRange;
+        family.InstanceId = id;
+
+        std::string path = options.generateDir + "/Instance_" + familyKey(family) + "_id" + std::to_string(id) + ".json";
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "Cannot write " << path << "\n";
+            return 1;
+        }
+        file << generateInstance(family, options.generateSeed).dump(1) << "\n";
+        written++;
+    }
+    std::cout << "Generated " << written << " instances in " << options.generateDir << "\n";
+    return 0;
+}
+
+// 擴展性研究中單一規模的量測結果 (時間皆為每次呼叫的平均秒數)
+struct ScalingPoint
+{
+    int Orders = 0;
+    int Parts = 0;
+    double ConstructionSeconds = 0.0;   // createMachineBatches
+    double ReintegrateSeconds = 0.0;    // reintegrateDelayedBatches
+    double SortAndInsertSeconds = 0.0;  // sortAndInsertParts
+    double IterationSeconds = 0.0;      // 一次 step2 + step3 + step4 (含排程複製)
+    unsigned long long ScheduleBytes = 0; // 複製一份初始排程配置的 heap 位元組
+    long long PeakRssKb = 0;
+};
+
+// 以 log-log 最小平方法擬合 y ∝ x^k，回傳 k；有效點少於兩個時回傳 0
+double fitGrowthExponent(const std::vector<std::pair<double, double>>& points)
+{
+    std::vector<std::pair<double, double>> logs;
+    for (const auto& point : points) {
+        if (point.first > 0 && point.second > 0) {
+            logs.emplace_back(std::log(point.first), std::log(point.second));
+        }
+    }
+    if (logs.size() < 2) {
+        return 0.0;
+    }
+    double meanX = 0.0, meanY = 0.0;
+    for (const auto& point : logs) {
+        meanX += point.first;
+        meanY += point.second;
+    }
+    meanX /= logs.size();
+    meanY /= logs.size();
+    double covariance = 0.0, variance = 0.0;
+    for (const auto& point : logs) {
+        covariance += (point.first - meanX) * (point.second - meanY);
+        variance += (point.first - meanX) * (point.first - meanX);
+    }
+    return variance > 0 ? covariance / variance : 0.0;
+}
+
+// 重複呼叫 op 直到累積 minSeconds 或呼叫 maxRepeats 次，回傳有效樣本的平均秒數。
+// op 回傳受測部分的秒數；沒有可量測的工作 (例如沒有延遲批次) 時回傳負值，不計入平均。
+// 完全沒有有效樣本時回傳 0
+template <typename Op>
+double averageSeconds(Op op, double minSeconds = 0.2, int maxRepeats = 200)
+{
+    double total = 0.0;
+    int samples = 0;
+    for (int repeats = 0; repeats < maxRepeats && (samples < 3 || total < minSeconds); repeats++) {
+        double seconds = op();
+        if (seconds >= 0) {
+            total += seconds;
+            samples++;
+        }
+    }
+    return samples > 0 ? total / samples : 0.0;
+}
+
+// 擴展性研究：以產生器建立訂單數逐次加倍的實例 (其他維度取 --gen-* 的第一個值)，
+// 量測各階段時間與記憶體，並擬合成長指數，指出哪個階段是超線性
+int runScaling(const DriverOptions& options)
+{
+    std::string instanceDir = options.outputDir + "/scaling";
+    std::filesystem::create_directories(instanceDir);
+
+    NullStreamBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    auto elapsedSince = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    std::vector<ScalingPoint> points;
+    int orders = options.generateOrders.front();
+    for (int step = 0; step < options.scalingSteps; step++, orders *= 2) {
+        InstanceFamily family;
+        family.Orders = orders;
+        family.ItemsPerOrder = options.generateItemsPerOrder.front();
+        family.Machines = options.generateMachines.front();
+        family.Materials = options.generateMaterials.front();
+        family.TardyPercent = options.generateTardyPercent.front();
+        family.DueDateRange = options.generateDueDateRange.front();
+        family.InstanceId = 0;
+
+        std::string path = instanceDir + "/Instance_" + familyKey(family) + "_id0.json";
+        {
+            std::ofstream file(path);
+            file << generateInstance(family, options.generateSeed).dump(1) << "\n";
+        }
+        std::unique_ptr<Instance> instance = loadInstance(path, options.solve);
+        const auto& sortedMachines = instance->sortedMachines;
+        CounterRng rng = CounterRng(options.solve.seed).split(static_cast<std::uint64_t>(orders));
+
+        ScalingPoint point;
+        point.Orders = orders;
+        point.Parts = calculateTotalSize(instance->finalSorted);
+
+        std::vector<MachineBatch> initial;
+        point.ConstructionSeconds = averageSeconds([&] {
+            auto start = std::chrono::steady_clock::now();
+            initial = createMachineBatches(instance->finalSorted, sortedMachines);
+            return elapsedSince(start);
+        });
+
+        unsigned long long bytesBefore = allocationCounters.Bytes;
+        std::vector<MachineBatch> copy = initial;
+        point.ScheduleBytes = allocationCounters.Bytes - bytesBefore;
+
+        point.ReintegrateSeconds = averageSeconds([&] {
+            copy = initial;
+            std::vector<DelayedBatch> delayedBatches = extractAndRandomSelectDelayedBatches(copy, sortedMachines, rng);
+            if (delayedBatches.empty()) {
+                return -1.0;
+            }
+            auto start = std::chrono::steady_clock::now();
+            reintegrateDelayedBatches(copy, delayedBatches, sortedMachines);
+            return elapsedSince(start);
+        });
+
+        point.SortAndInsertSeconds = averageSeconds([&] {
+            copy = initial;
+            std::vector<PartTypeOrderInfo> parts = extractAndRandomSelectParts(copy, rng);
+            if (parts.empty()) {
+                return -1.0;
+            }
+            updateMachineBatchesAfterExtraction(copy, parts, sortedMachines);
+            auto start = std::chrono::steady_clock::now();
+            sortAndInsertParts(copy, sortedMachines, parts);
+            return elapsedSince(start);
+        });
+
+        // 與搜尋迴圈相同的順序：第三、四步都從目前最佳解複製開始 (這裡最佳解固定為初始解)
+        AdaptiveMethodSelector methodSelector;
+        copy = initial;
+        point.IterationSeconds = averageSeconds([&] {
+            auto start = std::chrono::steady_clock::now();
+            step2(copy, sortedMachines, rng);
+            copy = initial;
+            step3(copy, sortedMachines, rng);
+            copy = initial;
+            step4(copy, sortedMachines, methodSelector, rng);
+            return elapsedSince(start);
+        });
+
+        point.PeakRssKb = peakRssKb();
+        points.push_back(point);
+    }
+
+    std::cout.rdbuf(coutBuffer);
+
+    std::ostringstream table;
+    table << "Scaling study: orders doubling from " << options.generateOrders.front()
+        << ", ipo " << options.generateItemsPerOrder.front()
+        << ", machines " << options.generateMachines.front()
+        << ", materials " << options.generateMaterials.front() << "\n\n";
+    table << std::right << std::setw(8) << "orders" << std::setw(8) << "parts"
+        << std::setw(16) << "construct_s"
+        << std::setw(16) << "reintegrate_s"
+        << std::setw(16) << "sortInsert_s"
+        << std::setw(16) << "iteration_s"
+        << std::setw(16) << "schedule_KiB"
+        << std::setw(14) << "peak_rss_KB" << "\n";
+    for (const auto& point : points) {
+        table << std::setw(8) << point.Orders << std::setw(8) << point.Parts
+            << std::setw(16) << point.ConstructionSeconds
+            << std::setw(16) << point.ReintegrateSeconds
+            << std::setw(16) << point.SortAndInsertSeconds
+            << std::setw(16) << point.IterationSeconds
+            << std::setw(16) << static_cast<double>(point.ScheduleBytes) / 1024.0
+            << std::setw(14) << point.PeakRssKb << "\n";
+    }
+
+    // 指數明顯大於 1 (留 0.15 的量測雜訊) 才判定為超線性
+    const std::pair<const char*, double ScalingPoint::*> phases[] = {
+        { "createMachineBatches", &ScalingPoint::ConstructionSeconds },
+        { "reintegrateDelayedBatches", &ScalingPoint::ReintegrateSeconds },
+        { "sortAndInsertParts", &ScalingPoint::SortAndInsertSeconds },
+        { "iteration (step2+3+4)", &ScalingPoint::IterationSeconds },
+    };
+    table << "(0 means the constructed schedule had no delayed batches at that size, so the phase had no work;\n"
+        " such sizes are left out of the fit. Tight due dates such as --gen-ddr 50 keep every size loaded.)\n";
+    table << "\nGrowth exponent k in time ~ parts^k\n";
+    for (const auto& phase : phases) {
+        std::vector<std::pair<double, double>> samples;
+        for (const auto& point : points) {
+            samples.emplace_back(point.Parts, point.*(phase.second));
+        }
+        double exponent = fitGrowthExponent(samples);
+        table << "  " << std::left << std::setw(28) << phase.first << std::right
+            << std::setw(8) << std::fixed << std::setprecision(2) << exponent
+            << (exponent > 1.15 ? "  superlinear" : "") << "\n";
+        table.unsetf(std::ios::fixed);
+        table << std::setprecision(6);
+    }
+    std::vector<std::pair<double, double>> memorySamples;
+    for (const auto& point : points) {
+        memorySamples.emplace_back(point.Parts, static_cast<double>(point.ScheduleBytes));
+    }
+    table << "  " << std::left << std::setw(28) << "schedule memory" << std::right
+        << std::setw(8) << std::fixed << std::setprecision(2) << fitGrowthExponent(memorySamples) << "\n";
+
+    std::ofstream scalingFile(options.outputDir + "/scaling.txt");
+    scalingFile << table.str();
+    std::cout << table.str();
+    return 0;
+}
+
+// 自我檢查：在產生的小實例上比對增量維護的量與從頭重算的結果，避免之後修改
+// updateMachineBatches、insertBatch 等函式時悄悄破壞它們。結果寫到 <out>/selfcheck.txt，有不一致時回傳 1
+struct SelfCheckResult
+{
+    std::string Check;
+    long long Cases = 0;
+    long long Failures = 0;
+};
+
+// 不看 MachineBatch::Hash，逐批次從頭計算整個排程的雜湊
+std::uint64_t recomputeScheduleHash(const std::vector<MachineBatch>& machineBatches)
+{
+    std::uint64_t hash = 0;
+    for (const auto& machineBatch : machineBatches) {
+        for (size_t i = 0; i < machineBatch.Batches.size(); i++) {
+            hash += batchHash(machineBatch.MachineId, i, machineBatch.Batches[i]);
+        }
+    }
+    return hash;
+}
+
+int runSelfChecks(const DriverOptions& options)
+{
+    std::string instanceDir = options.outputDir + "/selfcheck";
+    std::filesystem::create_directories(instanceDir);
+
+    NullStreamBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    const int rounds = 40;
+    SelfCheckResult hashCheck{ "hash == recompute after each operator" };
+    SelfCheckResult objectiveCheck{ "construction objective == recompute" };
+    SelfCheckResult tabuCheck{ "tabu projected objective == after apply" };
+    SelfCheckResult tabuHashCheck{ "tabu projected hash == after apply" };
+    SelfCheckResult dpCheck{ "resequence DP == brute force (<= 8 batches)" };
+    SelfCheckResult swapCheck{ "resequence swaps never worsen" };
+    auto closeEnough = [](double a, double b) {
+        return std::abs(a - b) <= 1e-9 * std::max(1.0, std::abs(b));
+    };
+
+    const InstanceFamily families[] = {
+        { 4, 5, 2, 2, 30, 50, 0 },
+        { 8, 5, 3, 2, 60, 50, 0 },
+        { 6, 8, 2, 3, 30, 250, 0 },
+    };
+    for (const InstanceFamily& family : families) {
+        std::string path = instanceDir + "/Instance_" + familyKey(family) + "_id0.json";
+        {
+            std::ofstream file(path);
+            file << generateInstance(family, options.generateSeed).dump(1) << "\n";
+        }
+        std::unique_ptr<Instance> instance = loadInstance(path, options.solve);
+        const auto& sortedMachines = instance->sortedMachines;
+        CounterRng rng = CounterRng(options.solve.seed).split(CounterRng::streamId(instance->Name));
+
+        auto checkHash = [&](const std::vector<MachineBatch>& schedule) {
+            hashCheck.Cases++;
+            if (scheduleHash(schedule) != recomputeScheduleHash(schedule)) {
+                hashCheck.Failures++;
+            }
+        };
+
+        // 每一輪依序套用所有運算子，每個運算子之後都檢查，並沿著結果繼續走
+        std::vector<MachineBatch> schedule = createMachineBatches(instance->finalSorted, sortedMachines);
+        checkHash(schedule);
+
+        // 建構時累計的目標值 (含換料時間) 要等於 updateMachineBatches 重算的值，否則各引擎的目標不一致
+        {
+            std::vector<MachineBatch> recomputed = schedule;
+            for (auto& machineBatch : recomputed) {
+                updateMachineBatches(machineBatch, sortedMachines);
+            }
+            objectiveCheck.Cases++;
+            if (!closeEnough(sumTotalWeightedDelay(schedule), sumTotalWeightedDelay(recomputed))) {
+                objectiveCheck.Failures++;
+            }
+        }
+        AdaptiveMethodSelector selector;
+        using Operator = std::function<void(std::vector<MachineBatch>&)>;
+        const Operator operators[] = {
+            [&](std::vector<MachineBatch>& s) { step2(s, sortedMachines, rng); },
+            [&](std::vector<MachineBatch>& s) { step3(s, sortedMachines, rng); },
+            [&](std::vector<MachineBatch>& s) { step4(s, sortedMachines, selector, rng); },
+            [&](std::vector<MachineBatch>& s) { method1(s, sortedMachines, rng); },
+            [&](std::vector<MachineBatch>& s) { method2(s, sortedMachines, rng); },
+            [&](std::vector<MachineBatch>& s) { method3(s, sortedMachines, rng); },
+            [&](std::vector<MachineBatch>& s) { method4(s, sortedMachines, rng); },
+            [&](std::vector<MachineBatch>& s) { method5(s, sortedMachines, rng); },
+            [&](std::vector<MachineBatch>& s) { method6(s, sortedMachines, rng); },
+        };
+        for (int round = 0; round < rounds; round++) {
+            for (const Operator& apply : operators) {
+                apply(schedule);
+                checkHash(schedule);
+            }
+        }
+
+        // 禁忌鄰域只重算受影響的機台：抽樣時估的目標值 (包括置換表命中時沿用的值) 要等於套用後的值，
+        // 也要等於整個排程從頭重算的值；增量算出的雜湊要等於套用後從頭重算的雜湊
+        std::vector<MachineBatch> tabuSchedule = createMachineBatches(instance->finalSorted, sortedMachines);
+        TabuNeighbourhood neighbourhood(tabuSchedule, sortedMachines);
+        TranspositionTable transpositions(1 << 12);
+        transpositions.store(neighbourhood.scheduleKey(), neighbourhood.objective());
+        for (int iteration = 0; iteration < rounds * 10; iteration++) {
+            TabuMove move;
+            if (!neighbourhood.sample(rng, move, transpositions)) {
+                continue;
+            }
+            neighbourhood.apply(move, iteration, 0);
+            tabuHashCheck.Cases++;
+            if (move.Hash != recomputeScheduleHash(tabuSchedule) || move.Hash != neighbourhood.scheduleKey()) {
+                tabuHashCheck.Failures++;
+            }
+            std::vector<MachineBatch> recomputed = tabuSchedule;
+            for (auto& machineBatch : recomputed) {
+                updateMachineBatches(machineBatch, sortedMachines);
+            }
+            tabuCheck.Cases++;
+            if (!closeEnough(move.Objective, neighbourhood.objective())
+                || !closeEnough(sumTotalWeightedDelay(recomputed), neighbourhood.objective())) {
+                tabuCheck.Failures++;
+            }
+            checkHash(tabuSchedule);
+        }
+
+        // 單機重排：2 到 8 個批次 (每種數量三次) 隨機打亂後，DP 要等於窮舉所有順序的最佳值，相鄰交換不得變差
+        for (const MachineBatch& source : schedule) {
+            for (size_t trial = 0; trial < 21; trial++) {
+                size_t count = 2 + trial % 7;
+                if (count > source.Batches.size()) {
+                    continue;
+                }
+                MachineBatch machineBatch = source;
+                machineBatch.Batches.resize(count);
+                for (size_t i = count; i > 1; i--) {
+                    std::swap(machineBatch.Batches[i - 1], machineBatch.Batches[rng.index(i)]);
+                }
+                updateMachineBatches(machineBatch, sortedMachines);
+                double before = machineBatch.TotalWeightedDelay;
+
+                std::vector<size_t> order(count);
+                std::iota(order.begin(), order.end(), 0);
+                double bruteForce = std::numeric_limits<double>::infinity();
+                MachineBatch permuted = machineBatch;
+                do {
+                    for (size_t i = 0; i < count; i++) {
+                        permuted.Batches[i] = machineBatch.Batches[order[i]];
+                    }
+                    updateMachineBatches(permuted, sortedMachines);
+                    bruteForce = std::min(bruteForce, permuted.TotalWeightedDelay);
+                } while (std::next_permutation(order.begin(), order.end()));
+
+                MachineBatch exact = machineBatch;
+                resequenceMachineBatches(exact, sortedMachines, MaxResequenceBatches);
+                dpCheck.Cases++;
+                if (!closeEnough(exact.TotalWeightedDelay, bruteForce) || exact.Batches.size() != count) {
+                    dpCheck.Failures++;
+                }
+
+                MachineBatch swapped = machineBatch;
+                resequenceMachineBatches(swapped, sortedMachines, 0);
+                swapCheck.Cases++;
+                if (swapped.TotalWeightedDelay > before + 1e-9 * std::max(1.0, before) || swapped.Batches.size() != count) {
+                    swapCheck.Failures++;
+                }
+            }
+        }
+    }
+
+    std::cout.rdbuf(coutBuffer);
+
+    std::vector<SelfCheckResult> results = { hashCheck, objectiveCheck, tabuCheck, tabuHashCheck, dpCheck, swapCheck };
+    std::ostringstream table;
+    table << std::left << std::setw(44) << "check" << std::right << std::setw(10) << "cases" << std::setw(10) << "failures" << "\n";
+    long long failures = 0;
+    for (const auto& result : results) {
+        table << std::left << std::setw(44) << result.Check << std::right
+            << std::setw(10) << result.Cases << std::setw(10) << result.Failures << "\n";
+        failures += result.Failures;
+    }
+    table << (failures == 0 ? "all checks passed" : "SELF-CHECK FAILED") << "\n";
+
+    std::ofstream selfCheckFile(options.outputDir + "/selfcheck.txt");
+    selfCheckFile << table.str();
+    std::cout << table.str();
+    return failures == 0 ? 0 : 1;
+}
+
+// 一般模式：以載入 → 求解 → 輸出管線跑完所有實例
+int runSweep(const DriverOptions& options, const std::vector<std::string>& inputFiles, ResultsSink* resultsSink)
+{
+    std::ofstream allTestFile(options.outputDir + "/allTest.txt"); // 全局結果文件
+
+    // 三段管線：載入執行緒預先解析實例，求解執行緒只做運算，輸出執行緒負責所有報告寫檔。
+    // 兩個佇列都有上限，避免預先載入或待寫出的實例佔用過多記憶體。
+    int threadCount = std::min<int>(options.threads, static_cast<int>(inputFiles.size()));
+    size_t queueDepth = options.queueDepth > 0 ? options.queueDepth : static_cast<size_t>(threadCount);
+    BoundedQueue<std::unique_ptr<Instance>> loadedQueue(queueDepth);
+    BoundedQueue<SolveResult> solvedQueue(queueDepth);
+
+    auto sweepStart = std::chrono::steady_clock::now();
+    size_t skippedInstances = 0;
+    std::atomic<bool> failed(false);
+
+    std::thread loader([&]() {
+        if (activeTrace) {
+            activeTrace->setThreadName("loader");
+        }
+        for (size_t index = 0; index < inputFiles.size(); ++index) {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - sweepStart).count();
+            if (options.timeBudgetSeconds > 0 && elapsed >= options.timeBudgetSeconds) {
+                skippedInstances = inputFiles.size() - index;
+                break;
+            }
+            try {
+                loadedQueue.push(loadInstance(inputFiles[index], options.solve));
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Failed to load " << inputFiles[index] << ": " << e.what() << "\n";
+                failed = true;
+            }
+        }
+        loadedQueue.close();
+    });
+
+    std::atomic<int> activeSolvers(threadCount);
+    auto solver = [&](int solverIndex) {
+        if (activeTrace) {
+            activeTrace->setThreadName("solver " + std::to_string(solverIndex));
+        }
+        std::unique_ptr<Instance> instance;
+        while (loadedQueue.pop(instance)) {
+            std::string filePath = instance->FilePath;
+            try {
+                solvedQueue.push(solveInstance(std::move(instance), options.solve));
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Failed to solve " << filePath << ": " << e.what() << "\n";
+                failed = true;
+            }
+        }
+        if (--activeSolvers == 0) {
+            solvedQueue.close();
+        }
+    };
+
+    std::thread writer([&]() {
+        if (activeTrace) {
+            activeTrace->setThreadName("writer");
+        }
+        std::unique_ptr<PerfCounters> perf;
+        if (options.solve.perfCounters) {
+            perf = std::make_unique<PerfCounters>();
+        }
+        SolveResult solveResult;
+        while (solvedQueue.pop(solveResult)) {
+            const std::string& instanceName = solveResult.stats.InstanceName;
+            std::string outputFileName = options.outputDir + "/output_" + instanceName + ".txt";
+
+            // 報告本身的計數在寫完後才知道，只出現在結構化輸出
+            PerfSample reportBegin = perf ? perf->read() : PerfSample();
+            std::ofstream outFile(outputFileName);
+            writeReport(solveResult, outFile, allTestFile);
+            outFile.close();
+            allTestFile.flush();
+            if (perf && solveResult.stats.PerfEnabled) {
+                solveResult.stats.Perf[PerfReport].accumulate(reportBegin, perf->read());
+            }
+
+            if (!options.solve.saveScheduleDir.empty()) {
+                std::ofstream scheduleFile(scheduleFilePath(options.solve.saveScheduleDir, instanceName));
+                if (scheduleFile) {
+                    writeSchedule(solveResult.bestMachineBatches, scheduleFile);
+                }
+                else {
+                    std::cerr << "Cannot write schedule for " << instanceName << "\n";
+                    failed = true;
+                }
+            }
+
+            if (resultsSink) {
+                resultsSink->write(solveResult.stats);
+            }
+        }
+    });
+
+    std::vector<std::thread> solvers;
+    for (int t = 0; t < threadCount; ++t) {
+        solvers.emplace_back(solver, t + 1);
+    }
+    for (auto& thread : solvers) {
+        thread.join();
+    }
+    loader.join();
+    writer.join();
+
+    if (skippedInstances > 0) {
+        std::cerr << "Time budget reached, skipped " << skippedInstances << " of " << inputFiles.size() << " instances\n";
+    }
+
+    allTestFile.close(); // 關閉全局結果文件
+
+    return failed ? 1 : 0;
+}
+// Linux 編譯：g++ -std=c++17 -O2 -pthread -I<nlohmann 所在目錄> example.cpp -o example
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return 0;
+        }
+    }
+
+    DriverOptions options;
+    std::vector<std::string> inputFiles;
+    std::unique_ptr<ResultsSink> resultsSink;
+    try {
+        options = parseArguments(argc, argv);
+        std::filesystem::create_directories(options.outputDir);
+        if (options.microbenchmark) {
+            return runMicrobenchmarks(options);
+        }
+        if (options.selfCheck) {
+            return runSelfChecks(options);
+        }
+        if (!options.generateDir.empty()) {
+            return runGenerator(options);
+        }
+        if (options.scaling) {
+            return runScaling(options);
+        }
+        inputFiles = expandInputs(options.inputs);
+        if (!options.solve.saveScheduleDir.empty()) {
+            std::filesystem::create_directories(options.solve.saveScheduleDir);
+        }
+        if (!options.resultsPath.empty()) {
+            resultsSink = std::make_unique<ResultsSink>(options.resultsPath);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (inputFiles.empty()) {
+        std::cerr << "No input instances found\n";
+        return 1;
+    }
+    if (options.solve.perfCounters && !PerfCounters().available()) {
+        std::cerr << "Hardware performance counters are unavailable (Linux perf_event_open required); continuing without them\n";
+    }
+
+    std::unique_ptr<TraceRecorder> traceRecorder;
+    if (!options.tracePath.empty()) {
+        traceRecorder = std::make_unique<TraceRecorder>();
+        traceRecorder->setThreadName("main");
+        activeTrace = traceRecorder.get();
+    }
+
+    int status = options.benchmark
+        ? runBenchmark(options, inputFiles, resultsSink.get())
+        : runSweep(options, inputFiles, resultsSink.get());
+
+    if (traceRecorder) {
+        activeTrace = nullptr;
+        try {
+            traceRecorder->write(options.tracePath);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            status = 1;
+        }
+    }
+    return status;
+}